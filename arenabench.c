@@ -0,0 +1,170 @@
+/*
+ * arenabench.c - Per-object free against arena reset on the mm heap
+ *
+ * usage: arenabench [-r <requests>] [-k <objects>] [-s <max size>]
+ *                   [-c <chunk size>]
+ *
+ * Simulates a server that allocates k small objects per request and
+ * drops them all when the request is done, once with mm_malloc and one
+ * mm_free per object, and once with an arena (mm_arena.h) that is
+ * reset after every request. Both runs write one byte of every object
+ * and use the same sequence of sizes, and each starts from a fresh
+ * heap. Times are measured with the driver's timer (config.h).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "mm.h"
+#include "mm_arena.h"
+#include "memlib.h"
+#include "fsecs.h"
+
+/* Benchmark parameters */
+typedef struct {
+    int requests;        /* simulated requests */
+    int objects;         /* objects allocated per request */
+    int *sizes;          /* size of each object of a request */
+    size_t chunk_size;   /* arena chunk size */
+    void **ptrs;         /* the live objects of the per-object run */
+    int failed;          /* an allocation returned NULL */
+} bench_t;
+
+int verbose = 0;         /* read by the timer routines */
+
+static void app_error(char *msg)
+{
+    fprintf(stderr, "arenabench: %s\n", msg);
+    exit(1);
+}
+
+/* start a run from an empty heap */
+static void fresh_heap(void)
+{
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed");
+}
+
+/* bench_free - allocate the objects of each request, then free each */
+static void bench_free(void *argp)
+{
+    bench_t *b = (bench_t *)argp;
+    char *p;
+    int r, i;
+
+    fresh_heap();
+    for (r = 0; r < b->requests; r++) {
+	for (i = 0; i < b->objects; i++) {
+	    if ((p = mm_malloc(b->sizes[i])) == NULL) {
+		b->failed = 1;
+		return;
+	    }
+	    *p = (char)i;
+	    b->ptrs[i] = p;
+	}
+	for (i = 0; i < b->objects; i++)
+	    mm_free(b->ptrs[i]);
+    }
+}
+
+/* bench_arena - allocate the objects of each request, then reset */
+static void bench_arena(void *argp)
+{
+    bench_t *b = (bench_t *)argp;
+    mm_arena_t *a;
+    char *p;
+    int r, i;
+
+    fresh_heap();
+    if ((a = mm_arena_create(b->chunk_size)) == NULL) {
+	b->failed = 1;
+	return;
+    }
+    for (r = 0; r < b->requests; r++) {
+	for (i = 0; i < b->objects; i++) {
+	    if ((p = mm_arena_alloc(a, b->sizes[i])) == NULL) {
+		b->failed = 1;
+		return;
+	    }
+	    *p = (char)i;
+	}
+	mm_arena_reset(a);
+    }
+    mm_arena_destroy(a);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: arenabench [-r <requests>] [-k <objects>] "
+	    "[-s <max size>] [-c <chunk size>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-r <n>     Simulated requests (1000).\n");
+    fprintf(stderr, "\t-k <n>     Objects allocated per request (1000).\n");
+    fprintf(stderr, "\t-s <n>     Object sizes are uniform in 1..n (64).\n");
+    fprintf(stderr, "\t-c <n>     Arena chunk size in bytes (%d).\n",
+	    MM_ARENA_CHUNK);
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
+
+int main(int argc, char **argv)
+{
+    bench_t b = {1000, 1000, NULL, MM_ARENA_CHUNK, NULL, 0};
+    int c, i, max_size = 64;
+    double ops, secs_free, secs_arena;
+    size_t heap_free, heap_arena;
+
+    while ((c = getopt(argc, argv, "r:k:s:c:h")) != EOF) {
+	switch (c) {
+	case 'r':
+	    b.requests = atoi(optarg);
+	    break;
+	case 'k':
+	    b.objects = atoi(optarg);
+	    break;
+	case 's':
+	    max_size = atoi(optarg);
+	    break;
+	case 'c':
+	    b.chunk_size = atol(optarg);
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (b.requests < 1 || b.objects < 1 || max_size < 1)
+	app_error("requests, objects and sizes must be positive");
+
+    b.sizes = (int *)malloc(b.objects * sizeof(int));
+    b.ptrs = (void **)malloc(b.objects * sizeof(void *));
+    if (b.sizes == NULL || b.ptrs == NULL)
+	app_error("no memory for the objects");
+    srand(1);
+    for (i = 0; i < b.objects; i++)
+	b.sizes[i] = 1 + rand() % max_size;
+
+    mem_init();
+    init_fsecs();
+    ops = (double)b.requests * b.objects;
+
+    secs_free = fsecs(bench_free, &b);
+    heap_free = mem_heapsize();
+    secs_arena = fsecs(bench_arena, &b);
+    heap_arena = mem_heapsize();
+    if (b.failed)
+	app_error("the heap ran out of memory");
+
+    printf("%d requests of %d objects of 1..%d bytes\n",
+	   b.requests, b.objects, max_size);
+    printf("%-16s%10s%10s%11s\n", "", "secs", "Kallocs", "heap KB");
+    printf("%-16s%10.6f%10.0f%11.0f\n", "per-object free",
+	   secs_free, ops / 1e3 / secs_free, heap_free / 1024.0);
+    printf("%-16s%10.6f%10.0f%11.0f\n", "arena reset",
+	   secs_arena, ops / 1e3 / secs_arena, heap_arena / 1024.0);
+    printf("Speedup %.1fx\n", secs_free / secs_arena);
+    exit(0);
+}
@@ -0,0 +1,190 @@
+/*
+ * compactbench.c - Heap recovered by compacting a fragmented blob cache
+ *
+ * usage: compactbench [-n <blobs>] [-s <max size>] [-e <evict %>]
+ *                     [-r <refill %>] [-g <growth>] [-p <pinned %>]
+ *
+ * Fills a cache with n blobs allocated through handles (mm_halloc),
+ * evicts a random share of them, and then refills a share of the
+ * evicted slots with blobs that are g times larger, so that the cache
+ * shrinks and the holes left by the evictions are mostly too small to
+ * reuse. It then runs mm_compact and reports
+ * the heap size before and after, and how long compaction took. A share
+ * of the blobs can be kept pinned, so that compaction has to leave them
+ * in place. Every blob is filled with a pattern that is checked after
+ * compaction.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+
+/* Benchmark parameters and the state of the cache */
+typedef struct {
+    int blobs;           /* blobs in the cache */
+    int max_size;        /* sizes of the first fill are uniform in 1..max */
+    int evict;           /* percentage of blobs evicted */
+    int refill;          /* percentage of evicted blobs replaced */
+    int growth;          /* refilled blobs are this many times larger */
+    int pinned;          /* percentage of blobs kept pinned */
+    mm_handle_t *h;      /* the blobs */
+    int *sizes;
+    size_t trimmed;      /* bytes mm_compact gave back */
+} bench_t;
+
+int verbose = 0;         /* read by the timer routines */
+
+static void app_error(char *msg)
+{
+    fprintf(stderr, "compactbench: %s\n", msg);
+    exit(1);
+}
+
+/* fill - allocate blob i with size bytes of its pattern */
+static void fill(bench_t *b, int i, int size)
+{
+    if ((b->h[i] = mm_halloc(size)) == MM_HNULL)
+	app_error("the heap ran out of memory");
+    b->sizes[i] = size;
+    memset(mm_hpin(b->h[i]), i & 0xff, size);
+    if (rand() % 100 >= b->pinned)
+	mm_hunpin(b->h[i]);
+}
+
+/* check - whether every blob still holds its pattern */
+static int check(bench_t *b)
+{
+    unsigned char *p;
+    int i, j, ok = 1;
+
+    for (i = 0; i < b->blobs; i++) {
+	if (b->h[i] == MM_HNULL)
+	    continue;
+	p = mm_hpin(b->h[i]);
+	for (j = 0; j < b->sizes[i]; j++)
+	    if (p[j] != (i & 0xff))
+		ok = 0;
+	mm_hunpin(b->h[i]);
+    }
+    return ok;
+}
+
+/* live - payload bytes of the blobs */
+static size_t live(bench_t *b)
+{
+    size_t bytes = 0;
+    int i;
+
+    for (i = 0; i < b->blobs; i++)
+	bytes += b->sizes[i];
+    return bytes;
+}
+
+static void compact(void *argp)
+{
+    bench_t *b = (bench_t *)argp;
+
+    b->trimmed = mm_compact();
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: compactbench [-n <blobs>] [-s <max size>] "
+	    "[-e <evict %%>] [-r <refill %%>]\n"
+	    "                    [-g <growth>] [-p <pinned %%>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-n <n>     Blobs in the cache (10000).\n");
+    fprintf(stderr, "\t-s <n>     First sizes are uniform in 1..n (256).\n");
+    fprintf(stderr, "\t-e <n>     Percentage of blobs evicted (75).\n");
+    fprintf(stderr, "\t-r <n>     Percentage of evicted blobs replaced "
+	    "(25).\n");
+    fprintf(stderr, "\t-g <n>     Refilled blobs are n times larger (2).\n");
+    fprintf(stderr, "\t-p <n>     Percentage of blobs kept pinned (0).\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
+
+int main(int argc, char **argv)
+{
+    bench_t b = {10000, 256, 75, 25, 2, 0, NULL, NULL, 0};
+    int c, i;
+    size_t heap_before, heap_after, bytes;
+    double secs;
+
+    while ((c = getopt(argc, argv, "n:s:e:r:g:p:h")) != EOF) {
+	switch (c) {
+	case 'n':
+	    b.blobs = atoi(optarg);
+	    break;
+	case 's':
+	    b.max_size = atoi(optarg);
+	    break;
+	case 'e':
+	    b.evict = atoi(optarg);
+	    break;
+	case 'r':
+	    b.refill = atoi(optarg);
+	    break;
+	case 'g':
+	    b.growth = atoi(optarg);
+	    break;
+	case 'p':
+	    b.pinned = atoi(optarg);
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (b.blobs < 1 || b.max_size < 1 || b.growth < 1)
+	app_error("blobs, sizes and growth must be positive");
+
+    b.h = (mm_handle_t *)malloc(b.blobs * sizeof(mm_handle_t));
+    b.sizes = (int *)malloc(b.blobs * sizeof(int));
+    if (b.h == NULL || b.sizes == NULL)
+	app_error("no memory for the blobs");
+
+    mem_init();
+    if (mm_init() < 0)
+	app_error("mm_init failed");
+    srand(1);
+    for (i = 0; i < b.blobs; i++)
+	fill(&b, i, 1 + rand() % b.max_size);
+    for (i = 0; i < b.blobs; i++) {
+	if (rand() % 100 < b.evict) {
+	    mm_hfree(b.h[i]);
+	    b.h[i] = MM_HNULL;
+	}
+    }
+    for (i = 0; i < b.blobs; i++) {
+	if (b.h[i] == MM_HNULL) {
+	    if (rand() % 100 < b.refill)
+		fill(&b, i, b.growth * (1 + rand() % b.max_size));
+	    else
+		b.sizes[i] = 0;
+	}
+    }
+
+    heap_before = mem_heapsize();
+    bytes = live(&b);
+    secs = ftimer_gettod(compact, &b, 1);
+    heap_after = mem_heapsize();
+    if (!check(&b))
+	app_error("a blob lost its contents");
+
+    printf("%d blobs, %d%% evicted, %d%% of those refilled %dx larger, "
+	   "%d%% pinned\n", b.blobs, b.evict, b.refill, b.growth, b.pinned);
+    printf("%-16s%11s%8s\n", "", "heap KB", "util");
+    printf("%-16s%11.0f%7.0f%%\n", "before compact",
+	   heap_before / 1024.0, 100.0 * bytes / heap_before);
+    printf("%-16s%11.0f%7.0f%%\n", "after compact",
+	   heap_after / 1024.0, 100.0 * bytes / heap_after);
+    printf("Gave back %.0f KB in %.3f ms\n", b.trimmed / 1024.0, secs * 1e3);
+    exit(0);
+}
@@ -52,6 +52,16 @@
   */
 #define UTIL_WEIGHT .60
 
+/*
+ * Thresholds for the baseline regression gate (mdriver -B). A trace
+ * regresses in throughput only if it is more than REGRESS_THRU_TOL
+ * slower than the baseline and the 95% confidence intervals of the
+ * two median times do not overlap. Utilization is deterministic, so a
+ * drop of more than REGRESS_UTIL_TOL is a regression by itself.
+ */
+#define REGRESS_THRU_TOL 0.10   /* 10% relative slowdown */
+#define REGRESS_UTIL_TOL 0.005  /* half a percentage point */
+
 /* 
  * Alignment requirement in bytes (either 4 or 8) 
  */
@@ -62,11 +72,40 @@
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
+/*
+ * Address at which memlib maps a heap file, the same in every process
+ * so that pointers stored in the heap stay valid
+ */
+#ifdef __LP64__
+#define MEM_FILE_ADDR ((void *)0x500000000000UL)
+#else
+#define MEM_FILE_ADDR ((void *)0x50000000UL)
+#endif
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_CLOCK  1   /* clock_gettime(CLOCK_MONOTONIC_RAW) (Linux, BSD) */
+#define USE_TSC    0   /* calibrated rdtscp time stamp counter (x86 only) */
+
+/*
+ * The USE_CLOCK and USE_TSC timers discard TIMER_WARMUP runs of each
+ * trace and then time TIMER_SAMPLES runs individually. The reported
+ * time is the median of those runs, together with its median absolute
+ * deviation and a 95% confidence interval.
+ */
+#define TIMER_WARMUP   2
+#define TIMER_SAMPLES 15
+
+/*
+ * The parameter tuner (mdriver -U) evaluates candidate configurations
+ * in TUNE_WORKERS processes at once (0 means one per online CPU), and
+ * makes at most TUNE_PASSES passes over the parameters.
+ */
+#define TUNE_WORKERS 0
+#define TUNE_PASSES  3
 
 #endif /* __CONFIG_H */
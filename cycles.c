@@ -0,0 +1,104 @@
+/*
+ * cycles.c - Calibration routines for the counter in cycles.h
+ *
+ * The counter rate is measured against CLOCK_MONOTONIC_RAW instead of
+ * being read from the CPU model, since the TSC on modern x86 runs at
+ * a constant nominal rate that need not match the current core clock.
+ */
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include "cycles.h"
+
+#define CAL_NSECS    20000000  /* length of the rate calibration window */
+#define OVHD_SAMPLES 10000     /* back-to-back reads for overhead estimate */
+
+static double hz = 0.0;        /* cached result of cycles_hz() */
+static cycles_t ovhd = 0;      /* cached result of cycles_overhead() */
+static int have_ovhd = 0;
+
+#ifdef CLOCK_MONOTONIC_RAW
+#define CAL_CLOCK CLOCK_MONOTONIC_RAW  /* not slewed by NTP */
+#else
+#define CAL_CLOCK CLOCK_MONOTONIC
+#endif
+
+/* return the calibration clock in nanoseconds */
+static double now_nsecs(void)
+{
+    struct timespec ts;
+    clock_gettime(CAL_CLOCK, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * cycles_hz - Estimate the counter rate by spinning for CAL_NSECS
+ *     nanoseconds of wall clock time. The result is cached.
+ */
+double cycles_hz(void)
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+    double t0, t1;
+    cycles_t c0, c1;
+
+    if (hz > 0.0)
+	return hz;
+
+    t0 = now_nsecs();
+    c0 = read_cycles();
+    do {
+	t1 = now_nsecs();
+    } while (t1 - t0 < CAL_NSECS);
+    c1 = read_cycles();
+    hz = (double)(c1 - c0) * 1e9 / (t1 - t0);
+#else
+    hz = 1e9;
+#endif
+    return hz;
+}
+
+/*
+ * cycles_invariant - On x86, check the CPUID "invariant TSC" flag.
+ *     Without it the TSC rate can change with frequency scaling and
+ *     the calibrated rate is only an approximation. The counters used
+ *     on other platforms are always constant-rate.
+ */
+int cycles_invariant(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0x80000000, NULL) < 0x80000007)
+	return 0;
+    __cpuid(0x80000007, eax, ebx, ecx, edx);
+    return (edx >> 8) & 1;
+#else
+    return 1;
+#endif
+}
+
+/*
+ * cycles_overhead - Return the smallest difference observed between
+ *     two consecutive read_cycles() calls. This is the floor that every
+ *     timed interval pays and can be subtracted from each sample.
+ */
+cycles_t cycles_overhead(void)
+{
+    int i;
+    cycles_t c0, c1, best = ~0ULL;
+
+    if (have_ovhd)
+	return ovhd;
+
+    for (i = 0; i < OVHD_SAMPLES; i++) {
+	c0 = read_cycles();
+	c1 = read_cycles();
+	if (c1 - c0 < best)
+	    best = c1 - c0;
+    }
+    ovhd = best;
+    have_ovhd = 1;
+    return ovhd;
+}
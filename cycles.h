@@ -0,0 +1,43 @@
+/*
+ * cycles.h - Low-overhead access to a free-running cycle counter
+ *
+ * read_cycles() is inline so that it can bracket a single allocator
+ * call without adding a function call of its own. On x86 it reads the
+ * time stamp counter with rdtscp, which waits for earlier instructions
+ * to retire; on AArch64 it reads the virtual counter. Everywhere else
+ * it falls back to clock_gettime(), so a "cycle" is one nanosecond.
+ */
+#ifndef __CYCLES_H_
+#define __CYCLES_H_
+
+#include <time.h>
+
+typedef unsigned long long cycles_t;
+
+static inline cycles_t read_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned lo, hi, aux;
+    __asm__ __volatile__("rdtscp" : "=a" (lo), "=d" (hi), "=c" (aux));
+    return ((cycles_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+    cycles_t val;
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r" (val));
+    return val;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (cycles_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* Estimate the rate of read_cycles() in ticks per second */
+double cycles_hz(void);
+
+/* Return nonzero if the counter ticks at a constant rate in all P/C-states */
+int cycles_invariant(void);
+
+/* Estimate the cost of a back-to-back pair of read_cycles() calls */
+cycles_t cycles_overhead(void);
+
+#endif /* __CYCLES_H_ */
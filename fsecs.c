@@ -6,6 +6,7 @@
 #include "fcyc.h"
 #include "clock.h"
 #include "ftimer.h"
+#include "cycles.h"
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
@@ -36,6 +37,20 @@ void init_fsecs(void)
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_CLOCK
+    if (verbose)
+	printf("Measuring performance with clock_gettime(), median of %d runs.\n",
+	       TIMER_SAMPLES);
+#elif USE_TSC
+    Mhz = cycles_hz() / 1e6;
+    if (verbose) {
+	printf("Measuring performance with the time stamp counter, "
+	       "median of %d runs.\n", TIMER_SAMPLES);
+	printf("Time stamp counter rate ~= %.1f MHz\n", Mhz);
+    }
+    if (!cycles_invariant())
+	printf("Warning: time stamp counter is not invariant; "
+	       "timings may drift with CPU frequency.\n");
 #endif
 }
 
@@ -44,14 +59,35 @@ void init_fsecs(void)
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
+    return fsecs_stats(f, argp, NULL);
+}
+
+/*
+ * fsecs_stats - Return the running time of a function f (in seconds)
+ *     and, if stats is not NULL, describe the spread of the runs. The
+ *     timers that only produce a single estimate report it as a
+ *     one-sample distribution.
+ */
+double fsecs_stats(fsecs_test_funct f, void *argp, ftimer_stats_t *stats)
+{
+    ftimer_stats_t st;
+
+#if USE_CLOCK
+    ftimer_clock(f, argp, TIMER_WARMUP, TIMER_SAMPLES, &st);
+#elif USE_TSC
+    ftimer_tsc(f, argp, TIMER_WARMUP, TIMER_SAMPLES, &st);
+#else
+    double secs;
 #if USE_FCYC
-    double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
+    secs = fcyc(f, argp)/(Mhz*1e6);
 #elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
+    secs = ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
+    secs = ftimer_gettod(f, argp, 10);
+#endif
+    ftimer_summarize(&secs, 1, &st);
 #endif 
+    if (stats)
+	*stats = st;
+    return st.median;
 }
-
-
@@ -1,4 +1,7 @@
+#include "ftimer.h"
+
 typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+double fsecs_stats(fsecs_test_funct f, void *argp, ftimer_stats_t *stats);
@@ -7,14 +7,32 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_clock:  version that uses clock_gettime(CLOCK_MONOTONIC_RAW)
+ *    ftimer_tsc:    version that uses the x86 time stamp counter
+ *
+ * The first two return the mean of n back-to-back runs. The last two
+ * time each run on its own after some warmup runs and return the
+ * median, which is far less sensitive to the occasional preempted or
+ * page-faulting run than the mean is.
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
 #include <sys/time.h>
 #include "ftimer.h"
+#include "cycles.h"
+
+#ifdef CLOCK_MONOTONIC_RAW
+#define FTIMER_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define FTIMER_CLOCK CLOCK_MONOTONIC
+#endif
 
 /* function prototypes */
 static void init_etime(void);
 static double get_etime(void);
+static int cmp_double(const void *a, const void *b);
 
 /* 
  * ftimer_itimer - Use the interval timer to estimate the running time
@@ -52,6 +70,124 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
     return (1E-3*diff);
 }
 
+/*
+ * ftimer_clock - Use clock_gettime to estimate the running time of
+ * f(argp). Run it warmup times untimed, then time n runs one by one.
+ * Return the median run time and fill in *stats if it is not NULL.
+ */
+double ftimer_clock(ftimer_test_funct f, void *argp, int warmup, int n,
+		    ftimer_stats_t *stats)
+{
+    int i;
+    struct timespec sts, ets;
+    double *samples;
+    ftimer_stats_t st;
+
+    if ((samples = malloc(n * sizeof(double))) == NULL) {
+	fprintf(stderr, "ftimer_clock: malloc error\n");
+	exit(1);
+    }
+    for (i = 0; i < warmup; i++)
+	f(argp);
+    for (i = 0; i < n; i++) {
+	clock_gettime(FTIMER_CLOCK, &sts);
+	f(argp);
+	clock_gettime(FTIMER_CLOCK, &ets);
+	samples[i] = (ets.tv_sec - sts.tv_sec) + 1E-9*(ets.tv_nsec - sts.tv_nsec);
+    }
+    ftimer_summarize(samples, n, &st);
+    free(samples);
+    if (stats)
+	*stats = st;
+    return st.median;
+}
+
+/*
+ * ftimer_tsc - Use the time stamp counter to estimate the running time
+ * of f(argp). Ticks are converted to seconds with the counter rate
+ * measured by cycles_hz(). Otherwise the same as ftimer_clock.
+ */
+double ftimer_tsc(ftimer_test_funct f, void *argp, int warmup, int n,
+		  ftimer_stats_t *stats)
+{
+    int i;
+    cycles_t start;
+    double *samples;
+    double hz = cycles_hz();
+    ftimer_stats_t st;
+
+    if ((samples = malloc(n * sizeof(double))) == NULL) {
+	fprintf(stderr, "ftimer_tsc: malloc error\n");
+	exit(1);
+    }
+    for (i = 0; i < warmup; i++)
+	f(argp);
+    for (i = 0; i < n; i++) {
+	start = read_cycles();
+	f(argp);
+	samples[i] = (double)(read_cycles() - start) / hz;
+    }
+    ftimer_summarize(samples, n, &st);
+    free(samples);
+    if (stats)
+	*stats = st;
+    return st.median;
+}
+
+/*
+ * ftimer_summarize - Compute median, MAD, min and mean of n samples.
+ * The confidence interval for the median is the distribution-free one
+ * given by the order statistics at ranks n/2 -+ 1.96*sqrt(n)/2, so it
+ * makes no assumption about the shape of the timing distribution.
+ */
+void ftimer_summarize(double *samples, int n, ftimer_stats_t *stats)
+{
+    int i, lo, hi;
+    double sum = 0.0, *dev;
+
+    stats->n = n;
+    if (n <= 0) {
+	stats->median = stats->mad = stats->ci_lo = stats->ci_hi = 0.0;
+	stats->min = stats->mean = 0.0;
+	return;
+    }
+
+    qsort(samples, n, sizeof(double), cmp_double);
+    for (i = 0; i < n; i++)
+	sum += samples[i];
+    stats->mean = sum / n;
+    stats->min = samples[0];
+    stats->median = (n % 2) ? samples[n/2] :
+	(samples[n/2 - 1] + samples[n/2]) / 2;
+
+    if ((dev = malloc(n * sizeof(double))) == NULL) {
+	fprintf(stderr, "ftimer_summarize: malloc error\n");
+	exit(1);
+    }
+    for (i = 0; i < n; i++)
+	dev[i] = fabs(samples[i] - stats->median);
+    qsort(dev, n, sizeof(double), cmp_double);
+    stats->mad = (n % 2) ? dev[n/2] : (dev[n/2 - 1] + dev[n/2]) / 2;
+    free(dev);
+
+    /* 1-based ranks of the interval ends, clamped to the sample */
+    lo = (int)floor(n / 2.0 - 0.98 * sqrt(n));
+    hi = (int)ceil(1 + n / 2.0 + 0.98 * sqrt(n));
+    if (lo < 1)
+	lo = 1;
+    if (hi > n)
+	hi = n;
+    stats->ci_lo = samples[lo - 1];
+    stats->ci_hi = samples[hi - 1];
+}
+
+/* qsort comparison for ascending doubles */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
 
 /*
  * Routines for manipulating the Unix interval timer
@@ -1,6 +1,9 @@
 /* 
  * Function timers 
  */
+#ifndef __FTIMER_H_
+#define __FTIMER_H_
+
 typedef void (*ftimer_test_funct)(void *); 
 
 /* Estimate the running time of f(argp) using the Unix interval timer.
@@ -12,3 +15,30 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+
+/* Robust summary of a set of individually timed runs (in seconds) */
+typedef struct {
+    int n;          /* number of timed runs */
+    double median;  /* median run time */
+    double mad;     /* median absolute deviation from the median */
+    double ci_lo;   /* 95% confidence interval for the median */
+    double ci_hi;
+    double min;     /* fastest run */
+    double mean;    /* arithmetic mean, for comparison with old timers */
+} ftimer_stats_t;
+
+/* Estimate the running time of f(argp) using CLOCK_MONOTONIC_RAW.
+   Discard warmup runs, then time n runs and return their median */
+double ftimer_clock(ftimer_test_funct f, void *argp, int warmup, int n,
+		    ftimer_stats_t *stats);
+
+/* Estimate the running time of f(argp) using the calibrated x86 time
+   stamp counter. Discard warmup runs, then time n runs and return
+   their median */
+double ftimer_tsc(ftimer_test_funct f, void *argp, int warmup, int n,
+		  ftimer_stats_t *stats);
+
+/* Compute the robust summary of n samples (reorders the samples) */
+void ftimer_summarize(double *samples, int n, ftimer_stats_t *stats);
+
+#endif /* __FTIMER_H_ */
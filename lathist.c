@@ -0,0 +1,118 @@
+/*
+ * lathist.c - Log-bucketed latency histograms
+ */
+#include <string.h>
+#include "lathist.h"
+
+/* position of the most significant set bit of v (v > 0) */
+static int msb(cycles_t v)
+{
+    return 63 - __builtin_clzll(v);
+}
+
+/* map a sample to its bucket index */
+static int bucket_of(cycles_t v)
+{
+    int e;
+
+    if (v < LAT_SUBBUCKETS)
+	return (int)v;
+    e = msb(v);
+    return (e - LAT_SUBBITS + 1) * LAT_SUBBUCKETS +
+	(int)((v >> (e - LAT_SUBBITS)) & (LAT_SUBBUCKETS - 1));
+}
+
+/* the largest value that maps to bucket b */
+static cycles_t bucket_hi(int b)
+{
+    int e, sub;
+
+    if (b < LAT_SUBBUCKETS)
+	return (cycles_t)b;
+    e = b / LAT_SUBBUCKETS + LAT_SUBBITS - 1;
+    sub = b % LAT_SUBBUCKETS;
+    return ((((cycles_t)LAT_SUBBUCKETS + sub + 1) << (e - LAT_SUBBITS))) - 1;
+}
+
+/*
+ * lathist_reset - Clear all samples from a histogram
+ */
+void lathist_reset(lathist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+/*
+ * lathist_add - Record one sample
+ */
+void lathist_add(lathist_t *h, cycles_t val)
+{
+    h->bucket[bucket_of(val)]++;
+    h->count++;
+    h->sum += (double)val;
+    if (val > h->max)
+	h->max = val;
+}
+
+/*
+ * lathist_merge - Add all samples of src into dst
+ */
+void lathist_merge(lathist_t *dst, const lathist_t *src)
+{
+    int i;
+
+    for (i = 0; i < LAT_NBUCKETS; i++)
+	dst->bucket[i] += src->bucket[i];
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->max > dst->max)
+	dst->max = src->max;
+}
+
+/*
+ * lathist_quantile - Return the q-th quantile (0 <= q <= 1). The
+ *     answer is the upper edge of the bucket holding that rank, capped
+ *     by the largest sample actually seen.
+ */
+cycles_t lathist_quantile(const lathist_t *h, double q)
+{
+    unsigned long long rank, seen = 0;
+    cycles_t hi;
+    int i;
+
+    if (h->count == 0)
+	return 0;
+    rank = (unsigned long long)(q * (double)h->count + 0.5);
+    if (rank < 1)
+	rank = 1;
+    for (i = 0; i < LAT_NBUCKETS; i++) {
+	seen += h->bucket[i];
+	if (seen >= rank) {
+	    hi = bucket_hi(i);
+	    return (hi < h->max) ? hi : h->max;
+	}
+    }
+    return h->max;
+}
+
+/*
+ * lathist_size_class - Map a request size in bytes to its size class:
+ *     class 0 holds sizes up to 16 bytes, class k sizes up to 16<<k,
+ *     and the last class everything larger.
+ */
+int lathist_size_class(int size)
+{
+    int cls = 0;
+
+    while (cls < LAT_NSIZES - 1 && size > (16 << cls))
+	cls++;
+    return cls;
+}
+
+/*
+ * lathist_size_class_max - Largest size in class cls (-1 if unbounded)
+ */
+int lathist_size_class_max(int cls)
+{
+    return (cls < LAT_NSIZES - 1) ? (16 << cls) : -1;
+}
@@ -0,0 +1,35 @@
+/*
+ * lathist.h - Log-bucketed latency histograms
+ *
+ * Each power of two is split into LAT_SUBBUCKETS linear sub-buckets,
+ * so a reported quantile is within 1/LAT_SUBBUCKETS of the true value
+ * while a histogram covering the full 64-bit range stays small enough
+ * to update on every allocator call.
+ */
+#ifndef __LATHIST_H_
+#define __LATHIST_H_
+
+#include "cycles.h"
+
+#define LAT_SUBBITS     3
+#define LAT_SUBBUCKETS  (1 << LAT_SUBBITS)
+#define LAT_NBUCKETS    ((64 - LAT_SUBBITS + 1) * LAT_SUBBUCKETS)
+
+/* Request sizes are grouped into power-of-two classes starting at 16 */
+#define LAT_NSIZES      16
+
+typedef struct {
+    unsigned long long count;             /* number of samples */
+    cycles_t max;                         /* largest sample */
+    double sum;                           /* sum of all samples */
+    unsigned long long bucket[LAT_NBUCKETS];
+} lathist_t;
+
+void lathist_reset(lathist_t *h);
+void lathist_add(lathist_t *h, cycles_t val);
+void lathist_merge(lathist_t *dst, const lathist_t *src);
+cycles_t lathist_quantile(const lathist_t *h, double q);
+int lathist_size_class(int size);
+int lathist_size_class_max(int cls);
+
+#endif /* __LATHIST_H_ */
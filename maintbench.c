@@ -0,0 +1,210 @@
+/*
+ * maintbench.c - Request latency of a growing heap with and without the
+ *     maintenance thread
+ *
+ * usage: maintbench [-n <objects>] [-s <max size>] [-f <free %>]
+ *                   [-w <work>] [-p <period us>] [-F <heap file>]
+ *
+ * Simulates a program that builds up its data: each step allocates an
+ * object, writes all of it, frees a random earlier object with some
+ * probability, and then does w units of other work. The heap grows
+ * steadily, so without help many steps extend the heap and fault in
+ * new pages. The run is done once on its own and once with the
+ * maintenance thread (mm_maint_start) running every p microseconds,
+ * each on a fresh heap with the same sizes. The report gives quantiles
+ * of the latency of allocating and writing an object, the heap
+ * extensions left to requests and those done by the thread, the KB of
+ * free blocks the thread released, and the minor page faults that the
+ * program itself took, not counting those of the thread.
+ *
+ * After the run the program frees every other object, and the thread
+ * idles on the heap for 20 periods and then for 20 more, in which it
+ * must release nothing: a page once released stays out until the
+ * program uses it again, and maintbench fails if the count still grows. With -F the heap is kept in a file
+ * (mem_init_file), whose pages a release has to punch out of the file
+ * rather than only unmap, e.g.
+ *   maintbench -n 800 -s 80000 -f 90 -w 20000 -F /tmp/maint.heap
+ */
+#define _GNU_SOURCE  /* RUSAGE_THREAD */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+#include "lathist.h"
+
+/* Benchmark parameters */
+typedef struct {
+    int objects;         /* objects allocated */
+    int max_size;        /* sizes are uniform in 1..max_size */
+    int free_pct;        /* percentage of steps that free an object */
+    int work;            /* units of other work per step */
+    int period_us;       /* maintenance period, 0 = no thread */
+    void **ptrs;         /* the objects, NULL once freed */
+    lathist_t lat;       /* latency of allocating and writing */
+    unsigned sink;       /* result of the other work */
+} bench_t;
+
+int verbose = 0;         /* read by the timer routines */
+
+static void app_error(char *msg)
+{
+    fprintf(stderr, "maintbench: %s\n", msg);
+    exit(1);
+}
+
+/* minflt - minor page faults taken by the calling thread so far */
+static long minflt(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_minflt;
+}
+
+/* run - one run on a fresh heap */
+static void run(void *argp)
+{
+    bench_t *b = (bench_t *)argp;
+    cycles_t start;
+    int i, j, size;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed");
+    if (b->period_us > 0 && mm_maint_start(b->period_us) < 0)
+	app_error("could not start the maintenance thread");
+    lathist_reset(&b->lat);
+    srand(1);
+    for (i = 0; i < b->objects; i++) {
+	size = 1 + rand() % b->max_size;
+	start = read_cycles();
+	if ((b->ptrs[i] = mm_malloc(size)) == NULL)
+	    app_error("the heap ran out of memory");
+	memset(b->ptrs[i], i & 0xff, size);
+	lathist_add(&b->lat, read_cycles() - start);
+
+	if (rand() % 100 < b->free_pct) {
+	    j = rand() % (i + 1);
+	    if (b->ptrs[j] != NULL)
+		mm_free(b->ptrs[j]);
+	    b->ptrs[j] = NULL;
+	}
+	for (j = 0; j < b->work; j++)
+	    b->sink = b->sink * 31 + j;
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: maintbench [-n <objects>] [-s <max size>] "
+	    "[-f <free %%>]\n"
+	    "                  [-w <work>] [-p <period us>] "
+	    "[-F <heap file>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-n <n>     Objects allocated (20000).\n");
+    fprintf(stderr, "\t-s <n>     Sizes are uniform in 1..n (1000).\n");
+    fprintf(stderr, "\t-f <n>     Percentage of steps that free (30).\n");
+    fprintf(stderr, "\t-w <n>     Units of other work per step (2000).\n");
+    fprintf(stderr, "\t-p <n>     Maintenance period in us (1000).\n");
+    fprintf(stderr, "\t-F <file>  Keep the heap in file.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
+
+int main(int argc, char **argv)
+{
+    bench_t b;
+    mm_heapstats_t hs;
+    double hz, secs;
+    long flt;
+    size_t released;
+    int c, i, period_us = 1000, pass;
+    char *path = NULL;
+
+    memset(&b, 0, sizeof(b));
+    b.objects = 20000;
+    b.max_size = 1000;
+    b.free_pct = 30;
+    b.work = 2000;
+    while ((c = getopt(argc, argv, "n:s:f:w:p:F:h")) != EOF) {
+	switch (c) {
+	case 'n':
+	    b.objects = atoi(optarg);
+	    break;
+	case 's':
+	    b.max_size = atoi(optarg);
+	    break;
+	case 'f':
+	    b.free_pct = atoi(optarg);
+	    break;
+	case 'w':
+	    b.work = atoi(optarg);
+	    break;
+	case 'p':
+	    period_us = atoi(optarg);
+	    break;
+	case 'F':
+	    path = optarg;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (b.objects < 1 || b.max_size < 1 || period_us < 1)
+	app_error("objects, sizes and the period must be positive");
+    if ((b.ptrs = calloc(b.objects, sizeof(void *))) == NULL)
+	app_error("no memory for the objects");
+
+    if (path != NULL)
+	mem_init_file(path);
+    else
+	mem_init();
+    init_fsecs();
+    hz = cycles_hz();
+    printf("%d objects of 1..%d bytes, %d%% of steps free, "
+	   "maintenance every %d us\n", b.objects, b.max_size, b.free_pct,
+	   period_us);
+    printf("%-10s%9s%9s%9s%9s%9s%9s%9s%9s%9s\n", "", "p50 us", "p99 us",
+	   "p99.9 us", "max us", "extends", "thr ext", "rel KB", "faults",
+	   "ms");
+    for (pass = 0; pass < 2; pass++) {
+	b.period_us = pass ? period_us : 0;
+	flt = minflt();
+	secs = ftimer_gettod(run, &b, 1);
+	flt = minflt() - flt;
+	/* Idle rounds on the finished heap must release nothing new */
+	for (i = 1; i < b.objects; i += 2) {
+	    if (b.ptrs[i] != NULL)
+		mm_free(b.ptrs[i]);
+	}
+	usleep(20 * b.period_us);
+	mm_heapstats(&hs);
+	released = hs.maint_released;
+	usleep(20 * b.period_us);
+	mm_maint_stop();
+	mm_heapstats(&hs);
+	if (hs.maint_released != released)
+	    app_error("the thread released the same pages again");
+	printf("%-10s%9.2f%9.2f%9.2f%9.2f%9lu%9lu%9lu%9ld%9.1f\n",
+	       pass ? "maint" : "inline",
+	       lathist_quantile(&b.lat, 0.5) * 1e6 / hz,
+	       lathist_quantile(&b.lat, 0.99) * 1e6 / hz,
+	       lathist_quantile(&b.lat, 0.999) * 1e6 / hz,
+	       b.lat.max * 1e6 / hz, (unsigned long)hs.extends,
+	       (unsigned long)hs.maint_extends,
+	       (unsigned long)(hs.maint_released / 1024), flt, secs * 1e3);
+	/* Give the pages back so that the next run faults them in again */
+	mem_release(mem_heap_lo(), mem_heapsize());
+    }
+    mem_deinit();
+    exit(0);
+}
@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE  /* RUSAGE_THREAD */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -16,10 +17,17 @@
 #include <float.h>
 #include <time.h>
 #include <getopt.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 
 #include "mm.h"
+#include "mm_null.h"
+#include "mm_registry.h"
 #include "memlib.h"
+#include "trace.h"
 #include "fsecs.h"
+#include "lathist.h"
+#include "perfctr.h"
 #include "config.h"
 
 /**********************
@@ -31,6 +39,25 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Latency mode (-L) */
+#define LAT_RUNS       10 /* timed replays of each trace, after one warmup */
+
+/* Payload-touching mode (-T) */
+#define TOUCH_INTERVAL 64 /* default number of ops between read sweeps */
+#define TOUCH_STRIDE   64 /* bytes between reads, i.e. one per cache line */
+
+/* Resident memory utilization (-R) */
+#define RSS_INTERVAL    8 /* ops between samples of the resident heap size */
+
+/* Fragmentation time series (-F) */
+#define FRAG_INTERVAL 100 /* default number of ops between samples */
+
+/* Machine-readable output and the baseline gate (-j, -c, -B) */
+#define CSVLINE      8192 /* max length of a line in a baseline CSV file */
+
+/* Parameter tuning (-U) */
+#define TUNE_MAXVALS    8 /* max values per tuned parameter */
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
 
@@ -45,24 +72,6 @@ typedef struct range_t {
     struct range_t *next;  /* next list element */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
-
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -71,14 +80,62 @@ typedef struct {
 typedef struct {
     trace_t *trace;  
     range_t *ranges;
+    int touch_pattern;   /* order of the read sweeps in eval_mm_touch */
+    int touch_interval;  /* ops between read sweeps in eval_mm_touch */
 } speed_t;
 
+/* Orders in which eval_mm_touch visits the live blocks */
+enum {TOUCH_SEQ, TOUCH_REV, TOUCH_RANDOM};
+
+/* Objectives of the parameter tuner */
+enum {TUNE_PERF, TUNE_P99, TUNE_RSS};
+
+/* The parameters the tuner searches over, each a field of mm_config_t */
+enum {TUNE_CHUNK, TUNE_BINS, TUNE_SUB, TUNE_SPLIT, TUNE_FIT, TUNE_POLICY,
+      TUNE_PLACE, TUNE_QUICK, TUNE_BACKEND, TUNE_NAXES};
+
+/* One parameter: the mm.c tunable it sets, and the values to try */
+typedef struct {
+    char *name;
+    int nvals;
+    long vals[TUNE_MAXVALS];
+} tune_axis_t;
+
+/* The outcome of running the traces with one configuration */
+typedef struct {
+    int valid;           /* every trace was replayed correctly */
+    double util;         /* average utilization */
+    double thru;         /* ops per second over all traces */
+    double perfindex;    /* as reported by the driver */
+    double p99_ns;       /* p99 latency of all ops (TUNE_P99) */
+    double rss;          /* sum of the peak resident bytes (TUNE_RSS) */
+    double score;        /* the objective, larger is better */
+} tune_result_t;
+
+/* Per-op latency histograms for one trace, by request type and size */
+typedef struct {
+    lathist_t op[3];                /* indexed by traceop_t type */
+    lathist_t size[3][LAT_NSIZES];  /* ... and by request size class */
+} latency_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    ftimer_stats_t timing; /* distribution of secs over the timed runs */
+    perf_counts_t perf;    /* event counts for one run (-P only) */
+    double ovhd_secs;      /* secs for the same replay with a null
+			      allocator, i.e. the driver's own cost (-O) */
+    double touch_secs;     /* secs for a payload-touching replay (-T) */
+    perf_counts_t touch_perf; /* event counts for that replay (-T) */
+    double rss_peak;       /* peak resident heap bytes (-R) */
+    double rss_util;       /* peak live bytes / peak resident bytes (-R) */
+    double rss_util_avg;   /* mean live bytes / mean resident bytes (-R) */
+    long faults;           /* minor page faults of the validity replay,
+			      which starts with no heap page resident */
+    mm_heapstats_t heap;   /* allocator's view of the heap at the end */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
@@ -91,8 +148,28 @@ typedef struct {
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int no_hints = 0;/* ignore the lifetime hints in traces (-H) */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
+/* The malloc package under evaluation, and all of those selected by -A */
+static const mm_allocator_t *mm;
+static const mm_allocator_t **allocs = NULL;
+static int num_allocs = 0;
+
+/* Search space of the parameter tuner (-U) */
+static tune_axis_t tune_axes[TUNE_NAXES] = {
+    {"CHUNKSIZE",    5, {1 << 10, 1 << 12, 1 << 13, 1 << 14, 1 << 16}},
+    {"SEG_LIST_LEN", 5, {12, 16, 20, 32, 64}},
+    {"BIN_SUB",      3, {0, 1, 2}},
+    {"SPLIT_MIN",    4, {0, 64, 128, 256}},
+    {"FIT_LIMIT",    4, {0, 4, 16, 64}},
+    {"FIT_POLICY",   MM_FIT_POLICIES,
+     {MM_FIT_FIRST, MM_FIT_NEXT, MM_FIT_BEST, MM_FIT_GOOD}},
+    {"PLACE_HIGH",   5, {0, 64, 128, 512, 2048}},
+    {"QUICK_MAX",    5, {0, 64, 128, 256, 512}},
+    {"MM_BACKEND",   2, {MM_BACKEND_SEGFIT, MM_BACKEND_BUDDY}},
+};
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -114,7 +191,6 @@ static void clear_ranges(range_t **ranges);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -124,10 +200,41 @@ static void eval_libc_speed(void *ptr);
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static void eval_mm_rss(trace_t *trace, stats_t *stats);
+static void eval_mm_frag(trace_t *trace, int tracenum, FILE *fp, int interval);
+static void eval_heapstats(mm_heapstats_t *hs);
+static void *eval_malloc(int size, int hint);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, latency_t *lat);
+
+/* Routine for measuring the overhead of the replay loop itself */
+static void eval_null_speed(void *ptr);
+
+/* Routine for measuring the locality of the blocks handed out by mm */
+static void eval_mm_touch(void *ptr);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlatency(int n, latency_t *lat);
+static void printperf(int n, stats_t *stats);
+static void printoverhead(int n, stats_t *stats);
+static void printtouch(int n, stats_t *stats, speed_t *params);
+static void printrss(int n, stats_t *stats);
+static void printfit(int n, stats_t *stats);
+static void printfaults(int n, stats_t *stats);
+static void printcompare(int n, stats_t **stats, double *perfindex);
+static void writejson(FILE *fp, int n, char **names, stats_t *stats,
+		      latency_t *lat, double perfindex, int first);
+static void writecsv(FILE *fp, int n, char **names, stats_t *stats,
+		     latency_t *lat, int header);
+static int compare_baseline(char *path, int n, char **names, stats_t *stats);
+static void add_allocator(const mm_allocator_t *a);
+static void add_allocators(char *arg);
+static int parse_touch(char *arg, speed_t *params);
+static int parse_tune(char *arg, int *objective, char **header);
+static void tune(int objective, char *header, char **tracefiles, int n);
+static double lat_ns(lathist_t *h, int k);
+static long minflt(void);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -146,11 +253,34 @@ int main(int argc, char **argv)
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    latency_t *mm_lat = NULL;  /* mm latency histograms for each trace */
+    stats_t **all_stats;       /* mm_stats of each allocator in allocs */
+    double *all_perfindex;     /* perf index of each allocator in allocs */
+    int total_errors = 0;      /* errors summed over all allocators */
+    int a;
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int latency = 0;     /* If set, record per-op latencies (set by -L) */
+    int perfctrs = 0;    /* If set, collect event counts (set by -P) */
+    int overhead = 0;    /* If set, measure harness overhead (set by -O) */
+    int touch = 0;       /* If set, touch payloads in a replay (set by -T) */
+    int rss = 0;         /* If set, measure resident utilization (-R) */
+    FILE *frag_fp = NULL;/* If set, write fragmentation CSV here (-F) */
+    int frag_interval = FRAG_INTERVAL; /* ops between -F samples */
+    char *json_path = NULL;    /* If set, write results as JSON (-j) */
+    char *csv_path = NULL;     /* If set, write results as CSV (-c) */
+    char *baseline_path = NULL;/* If set, compare with this CSV (-B) */
+    int regressions = 0;       /* traces that regressed against -B */
+    FILE *json_fp = NULL, *csv_fp = NULL;
+    char *tune_header = NULL;  /* If set, tune and write the result here (-U) */
+    size_t runahead = 0;       /* If set, pre-fault this far beyond brk (-W) */
+    int runahead_thread = 0;   /* ... on a helper thread */
+    long faults;
+    int tune_objective = TUNE_PERF;
+    char *comma;
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -159,7 +289,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:hvVgalA:LPORT:F:j:c:B:U:HW:")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -185,6 +315,71 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'A': /* Evaluate these malloc packages instead of mm */
+            add_allocators(optarg);
+            break;
+        case 'L': /* Record per-op latency histograms */
+            latency = 1;
+            break;
+        case 'P': /* Collect hardware and software event counts */
+            perfctrs = 1;
+            break;
+        case 'O': /* Subtract the cost of the driver's replay loop */
+            overhead = 1;
+            break;
+        case 'F': /* Write a fragmentation time series as CSV */
+	    if ((comma = strchr(optarg, ',')) != NULL) {
+		*comma = '\0';
+		if ((frag_interval = atoi(comma + 1)) <= 0) {
+		    usage();
+		    exit(1);
+		}
+	    }
+	    if ((frag_fp = fopen(optarg, "w")) == NULL) {
+		sprintf(msg, "Could not open %s for -F", optarg);
+		unix_error(msg);
+	    }
+	    fprintf(frag_fp, "allocator,trace,op,heap_bytes,live_bytes,internal_bytes,"
+		    "external_bytes,largest_free,free_blocks,alloc_blocks\n");
+            break;
+        case 'j': /* Write all results as JSON */
+            json_path = optarg;
+            break;
+        case 'c': /* Write all results as CSV */
+            csv_path = optarg;
+            break;
+        case 'B': /* Compare with a baseline CSV and fail on regressions */
+            baseline_path = optarg;
+            break;
+        case 'R': /* Measure utilization against resident pages */
+            rss = 1;
+            break;
+        case 'T': /* Replay while writing and reading the payloads */
+            touch = 1;
+            if (parse_touch(optarg, &speed_params) < 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'H': /* Ignore the lifetime hints in the traces */
+	    no_hints = 1;
+	    break;
+        case 'W': /* Keep a window of pages beyond brk faulted in */
+	    runahead = (size_t)atol(optarg) * 1024;
+	    if ((comma = strchr(optarg, ',')) != NULL) {
+		if (strcmp(comma + 1, "thread")) {
+		    usage();
+		    exit(1);
+		}
+		runahead_thread = 1;
+	    }
+	    break;
+        case 'U': /* Tune the parameters of the malloc package */
+	    if (parse_tune(optarg, &tune_objective, &tune_header) < 0) {
+		usage();
+		exit(1);
+	    }
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -239,6 +434,10 @@ int main(int argc, char **argv)
     /* Initialize the timing package */
     init_fsecs();
 
+    /* Open the event counters */
+    if (perfctrs || touch)
+	perf_init(verbose);
+
     /*
      * Optionally run and evaluate the libc malloc package 
      */
@@ -262,105 +461,260 @@ int main(int argc, char **argv)
 		speed_params.trace = trace;
 		if (verbose > 1)
 		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+		libc_stats[i].secs = fsecs_stats(eval_libc_speed, &speed_params,
+					       &libc_stats[i].timing);
+		if (perfctrs) {
+		    perf_start();
+		    eval_libc_speed(&speed_params);
+		    perf_stop(&libc_stats[i].perf);
+		}
 	    }
-	    free_trace(trace);
+	    trace_free(trace);
 	}
 
 	/* Display the libc results in a compact table */
 	if (verbose) {
 	    printf("\nResults for libc malloc:\n");
 	    printresults(num_tracefiles, libc_stats);
+	    if (perfctrs)
+		printperf(num_tracefiles, libc_stats);
 	}
     }
 
     /*
-     * Always run and evaluate the student's mm package
+     * Always run and evaluate the student's mm package, or the
+     * packages selected with -A
      */
-    if (verbose > 1)
-	printf("\nTesting mm malloc\n");
-
-    /* Allocate the mm stats array, with one stats_t struct per tracefile */
-    mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-    if (mm_stats == NULL)
-	unix_error("mm_stats calloc in main failed");
+    if (num_allocs == 0)
+	add_allocator(mm_allocator_at(0));
+    all_stats = (stats_t **)calloc(num_allocs, sizeof(stats_t *));
+    all_perfindex = (double *)calloc(num_allocs, sizeof(double));
+    if (all_stats == NULL || all_perfindex == NULL)
+	unix_error("all_stats calloc in main failed");
+    if (json_path) {
+	if ((json_fp = fopen(json_path, "w")) == NULL) {
+	    sprintf(msg, "Could not open %s for -j", json_path);
+	    unix_error(msg);
+	}
+	fprintf(json_fp, "{\n  \"allocators\": [\n");
+    }
+    if (csv_path && (csv_fp = fopen(csv_path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s for -c", csv_path);
+	unix_error(msg);
+    }
     
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
+    if (runahead > 0)
+	mem_set_runahead(runahead, runahead_thread);
+
+    /* Tune the first package instead of evaluating the packages */
+    if (tune_header) {
+	mm = allocs[0];
+	tune(tune_objective, tune_header, tracefiles, num_tracefiles);
+	exit(0);
+    }
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
+    for (a = 0; a < num_allocs; a++) {
+	mm = allocs[a];
+	errors = 0;
 	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
+	    printf("\nTesting %s malloc\n", mm->name);
+
+	/* Allocate the mm stats array, with one stats_t struct per tracefile */
+	mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+	if (mm_stats == NULL)
+	    unix_error("mm_stats calloc in main failed");
+	all_stats[a] = mm_stats;
+	if (latency) {
+	    mm_lat = (latency_t *)calloc(num_tracefiles, sizeof(latency_t));
+	    if (mm_lat == NULL)
+		unix_error("mm_lat calloc in main failed");
+	}
+
+	/* Evaluate student's mm malloc package using the K-best scheme */
+	for (i=0; i < num_tracefiles; i++) {
+	    trace = read_trace(tracedir, tracefiles[i]);
+	    mm_stats[i].ops = trace->num_ops;
 	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+		printf("Checking mm_malloc for correctness, ");
+	    faults = minflt();
+	    mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
+	    mm_stats[i].faults = minflt() - faults;
+	    if (mm_stats[i].valid) {
+		if (verbose > 1)
+		    printf("efficiency, ");
+		mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+		eval_heapstats(&mm_stats[i].heap);
+		if (rss)
+		    eval_mm_rss(trace, &mm_stats[i]);
+		if (frag_fp)
+		    eval_mm_frag(trace, i, frag_fp, frag_interval);
+		speed_params.trace = trace;
+		speed_params.ranges = ranges;
+		if (verbose > 1)
+		    printf("and performance.\n");
+		mm_stats[i].secs = fsecs_stats(eval_mm_speed, &speed_params,
+					       &mm_stats[i].timing);
+		if (perfctrs) {
+		    perf_start();
+		    eval_mm_speed(&speed_params);
+		    perf_stop(&mm_stats[i].perf);
+		}
+		if (overhead) {
+		    if (verbose > 1)
+			printf("Measuring harness overhead.\n");
+		    mm_stats[i].ovhd_secs = fsecs(eval_null_speed, &speed_params);
+		}
+		if (touch) {
+		    if (verbose > 1)
+			printf("Measuring payload locality.\n");
+		    mm_stats[i].touch_secs = fsecs(eval_mm_touch, &speed_params);
+		    perf_start();
+		    eval_mm_touch(&speed_params);
+		    perf_stop(&mm_stats[i].touch_perf);
+		}
+		if (latency) {
+		    if (verbose > 1)
+			printf("Measuring mm per-op latency.\n");
+		    eval_mm_latency(trace, &mm_lat[i]);
+		}
+	    }
+	    trace_free(trace);
 	}
-	free_trace(trace);
-    }
 
-    /* Display the mm results in a compact table */
-    if (verbose) {
-	printf("\nResults for mm malloc:\n");
-	printresults(num_tracefiles, mm_stats);
-	printf("\n");
-    }
+	/* Display the mm results in a compact table */
+	if (verbose) {
+	    printf("\nResults for %s malloc:\n", mm->name);
+	    printresults(num_tracefiles, mm_stats);
+	    printf("\n");
+	    printfit(num_tracefiles, mm_stats);
+	    printf("\n");
+	    printfaults(num_tracefiles, mm_stats);
+	    printf("\n");
+	}
 
-    /* 
-     * Accumulate the aggregate statistics for the student's mm package 
-     */
-    secs = 0;
-    ops = 0;
-    util = 0;
-    numcorrect = 0;
-    for (i=0; i < num_tracefiles; i++) {
-	secs += mm_stats[i].secs;
-	ops += mm_stats[i].ops;
-	util += mm_stats[i].util;
-	if (mm_stats[i].valid)
-	    numcorrect++;
-    }
-    avg_mm_util = util/num_tracefiles;
+	/* Display the allocator-only times */
+	if (overhead) {
+	    printf("Harness overhead for %s malloc:\n", mm->name);
+	    printoverhead(num_tracefiles, mm_stats);
+	    printf("\n");
+	}
 
-    /* 
-     * Compute and print the performance index 
-     */
-    if (errors == 0) {
-	avg_mm_throughput = ops/secs;
+	/* Display the event counts */
+	if (perfctrs) {
+	    printf("Event counts for %s malloc:\n", mm->name);
+	    printperf(num_tracefiles, mm_stats);
+	    printf("\n");
+	}
 
-	p1 = UTIL_WEIGHT * avg_mm_util;
-	if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
-	    p2 = (double)(1.0 - UTIL_WEIGHT);
-	} 
-	else {
-	    p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
-		(avg_mm_throughput/AVG_LIBC_THRUPUT);
+	/* Display the resident memory utilization */
+	if (rss) {
+	    printrss(num_tracefiles, mm_stats);
+	    printf("\n");
+	}
+
+	/* Display the payload-touching results */
+	if (touch) {
+	    printtouch(num_tracefiles, mm_stats, &speed_params);
+	    printf("\n");
+	}
+
+	/* Display the latency distributions */
+	if (latency) {
+	    printlatency(num_tracefiles, mm_lat);
+	    printf("\n");
 	}
+
+	/* 
+	 * Accumulate the aggregate statistics for the student's mm package 
+	 */
+	secs = 0;
+	ops = 0;
+	util = 0;
+	numcorrect = 0;
+	for (i=0; i < num_tracefiles; i++) {
+	    secs += mm_stats[i].secs;
+	    ops += mm_stats[i].ops;
+	    util += mm_stats[i].util;
+	    if (mm_stats[i].valid)
+		numcorrect++;
+	}
+	avg_mm_util = util/num_tracefiles;
+
+	/* 
+	 * Compute and print the performance index 
+	 */
+	if (num_allocs > 1)
+	    printf("%s: ", mm->name);
+	if (errors == 0) {
+	    avg_mm_throughput = ops/secs;
+
+	    p1 = UTIL_WEIGHT * avg_mm_util;
+	    if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
+		p2 = (double)(1.0 - UTIL_WEIGHT);
+	    } 
+	    else {
+		p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
+		    (avg_mm_throughput/AVG_LIBC_THRUPUT);
+	    }
 	
-	perfindex = (p1 + p2)*100.0;
-	printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
-	       p1*100, 
-	       p2*100, 
-	       perfindex);
+	    perfindex = (p1 + p2)*100.0;
+	    printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
+		   p1*100, 
+		   p2*100, 
+		   perfindex);
 	
+	}
+	else { /* There were errors */
+	    perfindex = 0.0;
+	    printf("Terminated with %d errors\n", errors);
+	}
+	all_perfindex[a] = perfindex;
+	total_errors += errors;
+
+	if (autograder && a == 0) {
+	    printf("correct:%d\n", numcorrect);
+	    printf("perfidx:%.0f\n", perfindex);
+	}
+
+	/* 
+	 * Write the machine-readable results and check them against the
+	 * baseline
+	 */
+	if (json_fp)
+	    writejson(json_fp, num_tracefiles, tracefiles, mm_stats, mm_lat,
+		      perfindex, a == 0);
+	if (csv_fp)
+	    writecsv(csv_fp, num_tracefiles, tracefiles, mm_stats, mm_lat, a == 0);
+	if (baseline_path)
+	    regressions += compare_baseline(baseline_path, num_tracefiles,
+					    tracefiles, mm_stats);
+	free(mm_lat);
+	mm_lat = NULL;
     }
-    else { /* There were errors */
-	perfindex = 0.0;
-	printf("Terminated with %d errors\n", errors);
-    }
 
-    if (autograder) {
-	printf("correct:%d\n", numcorrect);
-	printf("perfidx:%.0f\n", perfindex);
+    /* Show the packages side by side */
+    if (num_allocs > 1)
+	printcompare(num_tracefiles, all_stats, all_perfindex);
+
+    if (frag_fp)
+	fclose(frag_fp);
+    if (json_fp) {
+	fprintf(json_fp, "\n  ]\n}\n");
+	fclose(json_fp);
+    }
+    if (csv_fp)
+	fclose(csv_fp);
+    if (perfctrs || touch)
+	perf_deinit();
+
+    if (baseline_path) {
+	if (regressions > 0) {
+	    printf("Regression gate FAILED: %d regression(s)\n", regressions);
+	    exit(2);
+	}
+	printf("Regression gate passed\n");
     }
 
     exit(0);
@@ -470,103 +824,26 @@ static void clear_ranges(range_t **ranges)
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file, in either encoding, and store it in
+ *     memory
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
+    trace_t *trace;
+    int i;
 
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
-
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
     strcpy(path, tracedir);
     strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
-	}
-	op_index++;
-	
-    }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
+    trace = trace_read(path);
+    if (no_hints)
+	for (i = 0; i < trace->num_ops; i++)
+	    trace->ops[i].hint = 0;
     return trace;
 }
 
-/*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
- */
-void free_trace(trace_t *trace)
-{
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
-}
-
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -585,12 +862,17 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     char *oldp;
     char *p;
     
-    /* Reset the heap and free any records in the range list */
+    /* 
+     * Reset the heap and free any records in the range list. The pages
+     * of the heap, and any faulted in beyond it, are dropped so that the
+     * replay faults them in as a new process would.
+     */
     mem_reset_brk();
+    mem_release(mem_heap_lo(), MAX_HEAP);
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (mm->init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
@@ -605,7 +887,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if ((p = eval_malloc(size, trace->ops[i].hint)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -634,7 +916,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = mm->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
@@ -654,7 +936,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -672,7 +954,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    mm->free(p);
 	    break;
 
 	default:
@@ -708,7 +990,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (mm->init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -718,7 +1000,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = eval_malloc(size, trace->ops[i].hint)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -740,7 +1022,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
 	    /* Remember region and size */
@@ -761,7 +1043,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    mm->free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -779,6 +1061,168 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 }
 
 
+/*
+ * eval_mm_rss - Evaluate space utilization against the heap pages that
+ *   are actually resident instead of against the brk high water mark.
+ *   All heap pages are released first, and every payload is written
+ *   when it is allocated, as a program would. Pages the allocator
+ *   never touches, or hands back with mem_release(), then do not count
+ *   against it. Every RSS_INTERVAL ops the resident size is sampled;
+ *   stats->rss_util compares the peak live bytes with the peak
+ *   resident bytes, and stats->rss_util_avg the averages over the run.
+ */
+static void eval_mm_rss(trace_t *trace, stats_t *stats)
+{   
+    int i, index, size;
+    double total_size = 0, max_total_size = 0;
+    double resident, max_resident = 0, sum_live = 0, sum_resident = 0;
+    char *p;
+
+    /* drop every page of the previous trace, then start over */
+    mem_release(mem_heap_lo(), mem_heapsize());
+    mem_reset_brk();
+    if (mm->init() < 0)
+	app_error("mm_init failed in eval_mm_rss");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+        case ALLOC: /* mm_malloc */
+	    if ((p = eval_malloc(size, trace->ops[i].hint)) == NULL) 
+		app_error("mm_malloc failed in eval_mm_rss");
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    if ((p = mm->realloc(trace->blocks[index], size)) == NULL)
+		app_error("mm_realloc failed in eval_mm_rss");
+	    memset(p, index & 0xFF, size);
+	    total_size += size - (double)trace->block_sizes[index];
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case FREE: /* mm_free */
+	    mm->free(trace->blocks[index]);
+	    total_size -= trace->block_sizes[index];
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_rss");
+        }
+
+	if (total_size > max_total_size)
+	    max_total_size = total_size;
+	if ((i + 1) % RSS_INTERVAL == 0 || i == trace->num_ops - 1) {
+	    resident = mem_resident();
+	    if (resident > max_resident)
+		max_resident = resident;
+	    sum_live += total_size;
+	    sum_resident += resident;
+	}
+    }
+
+    stats->rss_peak = max_resident;
+    stats->rss_util = (max_resident > 0) ? max_total_size / max_resident : 0;
+    stats->rss_util_avg = (sum_resident > 0) ? sum_live / sum_resident : 0;
+}
+
+/*
+ * eval_mm_frag - Replay the trace and, every interval ops and after the
+ *   last one, write a CSV row that splits the heap into live payload,
+ *   internal fragmentation (the rest of the allocated blocks: headers,
+ *   footers and rounding), external fragmentation (free blocks), and
+ *   shows the largest free block. Whatever is left of heap_bytes is
+ *   allocator bookkeeping outside of any block.
+ */
+static void eval_mm_frag(trace_t *trace, int tracenum, FILE *fp, int interval)
+{
+    int i, index, size;
+    long live = 0;
+    char *p;
+    mm_heapstats_t hs;
+
+    mem_reset_brk();
+    if (mm->init() < 0)
+	app_error("mm_init failed in eval_mm_frag");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+        case ALLOC: /* mm_malloc */
+	    if ((p = eval_malloc(size, trace->ops[i].hint)) == NULL) 
+		app_error("mm_malloc failed in eval_mm_frag");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    live += size;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    if ((p = mm->realloc(trace->blocks[index], size)) == NULL)
+		app_error("mm_realloc failed in eval_mm_frag");
+	    live += size - (long)trace->block_sizes[index];
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case FREE: /* mm_free */
+	    mm->free(trace->blocks[index]);
+	    live -= trace->block_sizes[index];
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_frag");
+        }
+
+	if ((i + 1) % interval == 0 || i == trace->num_ops - 1) {
+	    eval_heapstats(&hs);
+	    fprintf(fp, "%s,%d,%d,%lu,%ld,%ld,%lu,%lu,%lu,%lu\n",
+		    mm->name, tracenum, i + 1,
+		    (unsigned long)hs.heap_bytes,
+		    live,
+		    (long)hs.alloc_bytes - live,
+		    (unsigned long)hs.free_bytes,
+		    (unsigned long)hs.largest_free,
+		    (unsigned long)hs.free_blocks,
+		    (unsigned long)hs.alloc_blocks);
+	}
+    }
+}
+
+/*
+ * eval_heapstats - Ask the package under evaluation for its view of the
+ *   heap. Packages that cannot report one count the whole heap as
+ *   allocated.
+ */
+static void eval_heapstats(mm_heapstats_t *hs)
+{
+    if (mm->heapstats) {
+	mm->heapstats(hs);
+	return;
+    }
+    memset(hs, 0, sizeof(*hs));
+    hs->heap_bytes = hs->alloc_bytes = mem_heapsize();
+}
+
+/*
+ * eval_malloc - Allocate size bytes from the package under evaluation,
+ *   passing on the lifetime hint of the trace op if it has one and the
+ *   package takes hints.
+ */
+static inline void *eval_malloc(int size, int hint)
+{
+    if (hint && mm->malloc_hint)
+	return mm->malloc_hint(size, hint);
+    return mm->malloc(size);
+}
+
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
  *    to measure the running time of the mm malloc package.
@@ -791,7 +1235,7 @@ static void eval_mm_speed(void *ptr)
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0) 
+    if (mm->init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
@@ -801,7 +1245,7 @@ static void eval_mm_speed(void *ptr)
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = eval_malloc(size, trace->ops[i].hint)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -810,7 +1254,7 @@ static void eval_mm_speed(void *ptr)
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+            if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
@@ -818,7 +1262,7 @@ static void eval_mm_speed(void *ptr)
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            mm->free(block);
             break;
 
 	default:
@@ -826,6 +1270,195 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * eval_null_speed - Replay the trace with eval_mm_speed itself, but
+ *    against the null allocator in mm_null.c, which does no work. It is
+ *    called through an mm_allocator_t like the package under
+ *    evaluation, and takes the hint path whenever that package does, so
+ *    the time this takes is what the driver itself adds to every
+ *    eval_mm_speed measurement: the dispatch on the request type, the
+ *    loads from the trace, the stores to trace->blocks, eval_malloc and
+ *    the indirect calls.
+ */
+static void eval_null_speed(void *ptr)
+{
+    static mm_allocator_t null_alloc = {
+	"null", null_init, null_malloc, null_free, null_realloc,
+	NULL, NULL, NULL, NULL
+    };
+    const mm_allocator_t *measured = mm;
+
+    null_alloc.malloc_hint = measured->malloc_hint ? null_malloc_hint : NULL;
+    mm = &null_alloc;
+    eval_mm_speed(ptr);
+    mm = measured;
+}
+
+/*
+ * eval_mm_touch - Replay the trace against the mm package like
+ *    eval_mm_speed, but use the payloads the way a program would: every
+ *    new or reallocated payload is written in full, and every
+ *    touch_interval ops a sweep reads one word per cache line from
+ *    touch_interval live blocks. The sweeps visit blocks in id order
+ *    (TOUCH_SEQ), in reverse id order (TOUCH_REV) or at random
+ *    (TOUCH_RANDOM), resuming where the previous sweep stopped. Since
+ *    ids are handed out in allocation order, the first two walk the
+ *    blocks in the order the program created them, which is cheap only
+ *    if the allocator placed them close together.
+ */
+static void eval_mm_touch(void *ptr)
+{
+    speed_t *params = (speed_t *)ptr;
+    trace_t *trace = params->trace;
+    int i, j, k, index, size, visited, cursor = 0;
+    unsigned rand_state = 12345;
+    char *live, *p;
+    size_t off;
+    volatile long sink = 0;
+    long sum = 0;
+
+    if ((live = (char *)calloc(trace->num_ids, 1)) == NULL)
+	unix_error("calloc failed in eval_mm_touch");
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_mm_touch");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+        case ALLOC: /* mm_malloc */
+            if ((p = eval_malloc(size, trace->ops[i].hint)) == NULL)
+		app_error("mm_malloc error in eval_mm_touch");
+	    memset(p, index & 0xFF, size);
+            trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    live[index] = 1;
+            break;
+
+	case REALLOC: /* mm_realloc */
+            if ((p = mm->realloc(trace->blocks[index], size)) == NULL)
+		app_error("mm_realloc error in eval_mm_touch");
+	    memset(p, index & 0xFF, size);
+            trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+            break;
+
+        case FREE: /* mm_free */
+            mm->free(trace->blocks[index]);
+	    live[index] = 0;
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_touch");
+        }
+
+	if ((i + 1) % params->touch_interval != 0)
+	    continue;
+
+	/* Read sweep over the next touch_interval live blocks */
+	visited = 0;
+	for (k = 0; k < trace->num_ids && visited < params->touch_interval; k++) {
+	    switch (params->touch_pattern) {
+	    case TOUCH_REV:
+		cursor = (cursor + trace->num_ids - 1) % trace->num_ids;
+		j = cursor;
+		break;
+	    case TOUCH_RANDOM:
+		rand_state = rand_state * 1103515245 + 12345;
+		j = (rand_state >> 8) % trace->num_ids;
+		break;
+	    default:
+		cursor = (cursor + 1) % trace->num_ids;
+		j = cursor;
+		break;
+	    }
+	    if (!live[j])
+		continue;
+	    p = trace->blocks[j];
+	    for (off = 0; off < trace->block_sizes[j]; off += TOUCH_STRIDE)
+		sum += p[off];
+	    visited++;
+	}
+    }
+    sink = sum;
+    (void)sink;
+    free(live);
+}
+
+/*
+ * eval_mm_latency - Replay the trace LAT_RUNS times and time every
+ *    mm_malloc, mm_free and mm_realloc call individually with the cycle
+ *    counter. The cost of reading the counter itself is measured once
+ *    and subtracted from each sample. A warmup replay, whose samples
+ *    are discarded, precedes the timed ones.
+ */
+static void eval_mm_latency(trace_t *trace, latency_t *lat)
+{
+    int i, run, index, size, type;
+    char *p;
+    cycles_t start, elapsed, ovhd;
+
+    ovhd = cycles_overhead();
+    memset(lat, 0, sizeof(*lat));
+
+    for (run = 0; run <= LAT_RUNS; run++) {
+	mem_reset_brk();
+	if (mm->init() < 0)
+	    app_error("mm_init failed in eval_mm_latency");
+
+	for (i = 0;  i < trace->num_ops;  i++) {
+	    type = trace->ops[i].type;
+	    index = trace->ops[i].index;
+
+	    switch (type) {
+	    case ALLOC: /* mm_malloc */
+		size = trace->ops[i].size;
+		start = read_cycles();
+		p = eval_malloc(size, trace->ops[i].hint);
+		elapsed = read_cycles() - start;
+		if (p == NULL)
+		    app_error("mm_malloc error in eval_mm_latency");
+		trace->blocks[index] = p;
+		trace->block_sizes[index] = size;
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		size = trace->ops[i].size;
+		start = read_cycles();
+		p = mm->realloc(trace->blocks[index], size);
+		elapsed = read_cycles() - start;
+		if (p == NULL)
+		    app_error("mm_realloc error in eval_mm_latency");
+		trace->blocks[index] = p;
+		trace->block_sizes[index] = size;
+		break;
+
+	    case FREE: /* mm_free */
+		size = trace->block_sizes[index];
+		p = trace->blocks[index];
+		start = read_cycles();
+		mm->free(p);
+		elapsed = read_cycles() - start;
+		break;
+
+	    default:
+		app_error("Nonexistent request type in eval_mm_latency");
+		return;
+	    }
+
+	    if (run == 0)
+		continue;
+	    elapsed = (elapsed > ovhd) ? elapsed - ovhd : 0;
+	    lathist_add(&lat->op[type], elapsed);
+	    lathist_add(&lat->size[type][lathist_size_class(size)], elapsed);
+	}
+    }
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -911,6 +1544,283 @@ static void eval_libc_speed(void *ptr)
     }
 }
 
+/*****************************************************************
+ * The following routines tune the run-time parameters (mm_config_t)
+ * of a malloc package. Each candidate configuration is evaluated on
+ * all traces in a worker process of its own, so that the candidates
+ * of one step of the search run in parallel.
+ ****************************************************************/
+
+/* tune_get - the value of parameter axis in configuration c */
+static long tune_get(const mm_config_t *c, int axis)
+{
+    switch (axis) {
+    case TUNE_CHUNK: return c->chunksize;
+    case TUNE_BINS:  return c->bins;
+    case TUNE_SUB:   return c->bin_sub;
+    case TUNE_SPLIT: return c->split_min;
+    case TUNE_FIT:   return c->fit_limit;
+    case TUNE_POLICY: return c->fit_policy;
+    case TUNE_PLACE: return c->place_high;
+    case TUNE_QUICK: return c->quick_max;
+    default:         return c->backend;
+    }
+}
+
+/* tune_set - set parameter axis of configuration c to val */
+static void tune_set(mm_config_t *c, int axis, long val)
+{
+    switch (axis) {
+    case TUNE_CHUNK: c->chunksize = val; break;
+    case TUNE_BINS:  c->bins = val; break;
+    case TUNE_SUB:   c->bin_sub = val; break;
+    case TUNE_SPLIT: c->split_min = val; break;
+    case TUNE_FIT:   c->fit_limit = val; break;
+    case TUNE_POLICY: c->fit_policy = val; break;
+    case TUNE_PLACE: c->place_high = val; break;
+    case TUNE_QUICK: c->quick_max = val; break;
+    default:         c->backend = val; break;
+    }
+}
+
+/*
+ * tune_eval - run every trace with configuration c and score it. This
+ *     is what each worker process does.
+ */
+static void tune_eval(const mm_config_t *c, trace_t **traces, int n,
+		      int objective, tune_result_t *r)
+{
+    speed_t params;
+    range_t *ranges = NULL;
+    latency_t *lat = NULL;
+    lathist_t all;
+    stats_t st;
+    double secs = 0, ops = 0, p2;
+    int i, t;
+
+    memset(r, 0, sizeof(*r));
+    r->valid = 1;
+    lathist_reset(&all);
+    if (objective == TUNE_P99 && (lat = malloc(sizeof(latency_t))) == NULL)
+	unix_error("malloc failed in tune_eval");
+    mm->config(c);
+
+    for (i = 0; i < n && r->valid; i++) {
+	if (!(r->valid = eval_mm_valid(traces[i], i, &ranges)))
+	    break;
+	r->util += eval_mm_util(traces[i], i, &ranges);
+	params.trace = traces[i];
+	params.ranges = ranges;
+	secs += fsecs(eval_mm_speed, &params);
+	ops += traces[i]->num_ops;
+	if (objective == TUNE_P99) {
+	    eval_mm_latency(traces[i], lat);
+	    for (t = 0; t < 3; t++)
+		lathist_merge(&all, &lat->op[t]);
+	}
+	if (objective == TUNE_RSS) {
+	    eval_mm_rss(traces[i], &st);
+	    r->rss += st.rss_peak;
+	}
+    }
+    free(lat);
+    if (!r->valid) {
+	r->score = -DBL_MAX;
+	return;
+    }
+
+    /* the same performance index as main computes */
+    r->util /= n;
+    r->thru = ops / secs;
+    p2 = (r->thru > AVG_LIBC_THRUPUT) ? 1.0 : r->thru / AVG_LIBC_THRUPUT;
+    r->perfindex = (UTIL_WEIGHT * r->util + (1.0 - UTIL_WEIGHT) * p2) * 100.0;
+    if (objective == TUNE_P99)
+	r->p99_ns = lat_ns(&all, 1);
+
+    switch (objective) {
+    case TUNE_P99: r->score = -r->p99_ns; break;
+    case TUNE_RSS: r->score = -r->rss; break;
+    default:       r->score = r->perfindex; break;
+    }
+}
+
+/*
+ * tune_batch - evaluate n configurations, running up to workers of
+ *     them at once in child processes. A worker that dies counts as an
+ *     invalid configuration.
+ */
+static void tune_batch(mm_config_t *cfgs, tune_result_t *res, int n,
+		       trace_t **traces, int ntraces, int objective,
+		       int workers)
+{
+    int start, end, j, fd[2], *fds;
+    pid_t *pids;
+
+    fds = (int *)malloc(n * sizeof(int));
+    pids = (pid_t *)malloc(n * sizeof(pid_t));
+    if (fds == NULL || pids == NULL)
+	unix_error("malloc failed in tune_batch");
+
+    for (start = 0; start < n; start = end) {
+	end = (start + workers < n) ? start + workers : n;
+	fflush(stdout);
+	for (j = start; j < end; j++) {
+	    if (pipe(fd) < 0)
+		unix_error("pipe failed in tune_batch");
+	    if ((pids[j] = fork()) < 0)
+		unix_error("fork failed in tune_batch");
+	    if (pids[j] == 0) {
+		close(fd[0]);
+		tune_eval(&cfgs[j], traces, ntraces, objective, &res[j]);
+		if (write(fd[1], &res[j], sizeof(res[j])) != sizeof(res[j]))
+		    unix_error("write failed in tune_batch");
+		fflush(stdout);
+		_exit(0);
+	    }
+	    close(fd[1]);
+	    fds[j] = fd[0];
+	}
+	for (j = start; j < end; j++) {
+	    if (read(fds[j], &res[j], sizeof(res[j])) != sizeof(res[j])) {
+		memset(&res[j], 0, sizeof(res[j]));
+		res[j].score = -DBL_MAX;
+	    }
+	    close(fds[j]);
+	    waitpid(pids[j], NULL, 0);
+	}
+    }
+    free(fds);
+    free(pids);
+}
+
+/* tune_print - one line of the tuning log */
+static void tune_print(const mm_config_t *c, const tune_result_t *r,
+		       int objective)
+{
+    int k;
+
+    for (k = 0; k < TUNE_NAXES; k++)
+	printf("%*ld", k == 0 ? 9 : 6, tune_get(c, k));
+    if (!r->valid) {
+	printf("%8s\n", "invalid");
+	return;
+    }
+    printf("%6.1f%%%8.0f%7.1f", r->util * 100.0, r->thru / 1e3,
+	   r->perfindex);
+    if (objective == TUNE_P99)
+	printf("%9.0f", r->p99_ns);
+    if (objective == TUNE_RSS)
+	printf("%9.0f", r->rss / 1024);
+    printf("\n");
+}
+
+/*
+ * tune - search the parameters of the package mm for the best value of
+ *     the objective on the given traces, and write them as a header
+ *     that mm.c can be built with. The search is coordinate descent
+ *     from the compiled-in defaults: all values of one parameter are
+ *     tried with the others fixed, the best is kept, and passes over
+ *     the parameters repeat until none of them improves the objective.
+ */
+static void tune(int objective, char *header, char **tracefiles, int n)
+{
+    static char *objnames[] = {"perf", "p99", "rss"};
+    trace_t **traces;
+    mm_config_t best, cfgs[TUNE_MAXVALS];
+    tune_result_t best_res, res[TUNE_MAXVALS];
+    int i, k, v, nc, pass, improved, workers;
+    long val, diff;
+    FILE *fp;
+
+    if (mm->config == NULL || mm->get_config == NULL) {
+	sprintf(msg, "Malloc package %s has no run-time parameters", mm->name);
+	app_error(msg);
+    }
+    if ((traces = (trace_t **)malloc(n * sizeof(trace_t *))) == NULL)
+	unix_error("malloc failed in tune");
+    for (i = 0; i < n; i++)
+	traces[i] = read_trace(tracedir, tracefiles[i]);
+    workers = (TUNE_WORKERS > 0) ? TUNE_WORKERS :
+	(int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1)
+	workers = 1;
+
+    /* Start from the allowed values closest to the defaults */
+    mm->config(NULL);
+    mm->get_config(&best);
+    for (k = 0; k < TUNE_NAXES; k++) {
+	val = tune_axes[k].vals[0];
+	for (v = 1; v < tune_axes[k].nvals; v++) {
+	    diff = tune_axes[k].vals[v] - tune_get(&best, k);
+	    if (labs(diff) < labs(val - tune_get(&best, k)))
+		val = tune_axes[k].vals[v];
+	}
+	tune_set(&best, k, val);
+    }
+
+    printf("Tuning %s for %s on %d traces with %d workers:\n",
+	   mm->name, objnames[objective], n, workers);
+    for (k = 0; k < TUNE_NAXES; k++)
+	printf("%*.*s", k == 0 ? 9 : 6, k == 0 ? 9 : 5, tune_axes[k].name);
+    printf("%7s%8s%7s", "util", "Kops", "perf");
+    if (objective == TUNE_P99)
+	printf("%9s", "p99 ns");
+    if (objective == TUNE_RSS)
+	printf("%9s", "rss KB");
+    printf("\n");
+    tune_batch(&best, &best_res, 1, traces, n, objective, workers);
+    tune_print(&best, &best_res, objective);
+
+    for (pass = 0, improved = 1; pass < TUNE_PASSES && improved; pass++) {
+	improved = 0;
+	for (k = 0; k < TUNE_NAXES; k++) {
+	    for (v = nc = 0; v < tune_axes[k].nvals; v++) {
+		if (tune_axes[k].vals[v] == tune_get(&best, k))
+		    continue;
+		cfgs[nc] = best;
+		tune_set(&cfgs[nc++], k, tune_axes[k].vals[v]);
+	    }
+	    tune_batch(cfgs, res, nc, traces, n, objective, workers);
+	    for (v = 0; v < nc; v++) {
+		tune_print(&cfgs[v], &res[v], objective);
+		if (res[v].score > best_res.score) {
+		    best = cfgs[v];
+		    best_res = res[v];
+		    improved = 1;
+		}
+	    }
+	}
+    }
+    if (!best_res.valid)
+	app_error("No configuration replayed the traces correctly");
+
+    printf("Best:\n");
+    tune_print(&best, &best_res, objective);
+
+    /* Write the parameters as mm.c sees them, after clamping */
+    mm->config(&best);
+    mm->get_config(&best);
+    if ((fp = fopen(header, "w")) == NULL) {
+	sprintf(msg, "Could not open %s for -U", header);
+	unix_error(msg);
+    }
+    fprintf(fp, "/*\n * mm.c parameters tuned by mdriver -U %s on",
+	    objnames[objective]);
+    for (i = 0; i < n; i++)
+	fprintf(fp, " %s", tracefiles[i]);
+    fprintf(fp, "\n * Build mm.c with them using make MM_TUNED=%s\n */\n",
+	    header);
+    for (k = 0; k < TUNE_NAXES; k++)
+	fprintf(fp, "#ifndef %s\n#define %s %ld\n#endif\n",
+		tune_axes[k].name, tune_axes[k].name, tune_get(&best, k));
+    fclose(fp);
+    printf("Wrote %s\n", header);
+
+    for (i = 0; i < n; i++)
+	trace_free(traces[i]);
+    free(traces);
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -927,17 +1837,20 @@ static void printresults(int n, stats_t *stats)
     double util = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%8s%10s%6s%7s%7s\n", 
+	   "trace", " valid", "util", "ops", "secs", "Kops", "mad", "ci95");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f%6.1f%%%6.1f%%\n", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
-		   (stats[i].ops/1e3)/stats[i].secs);
+		   (stats[i].ops/1e3)/stats[i].secs,
+		   100.0 * stats[i].timing.mad / stats[i].secs,
+		   50.0 * (stats[i].timing.ci_hi - stats[i].timing.ci_lo) /
+		   stats[i].secs);
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
@@ -973,6 +1886,721 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printlatency - prints the per-op latency quantiles of the mm package
+ *     for each trace, converted from counter ticks to nanoseconds
+ */
+static void printlatency(int n, latency_t *lat)
+{
+    static const char *opname[3] = {"malloc", "free", "realloc"};
+    double ns = 1e9 / cycles_hz();
+    char sizebuf[16];
+    lathist_t *h;
+    int i, t, c;
+
+    printf("Per-op latency for %s (ns, %llu tick timer overhead "
+	   "removed, %.0f MHz counter):\n",
+	   mm->name, cycles_overhead(), cycles_hz() / 1e6);
+    for (i = 0; i < n; i++) {
+	printf("trace %d\n", i);
+	printf("%9s%9s%10s%8s%8s%8s%9s\n",
+	       "op", "size", "count", "p50", "p99", "p99.9", "max");
+	for (t = 0; t < 3; t++) {
+	    for (c = -1; c < LAT_NSIZES; c++) {
+		if (c < 0) {
+		    h = &lat[i].op[t];
+		    strcpy(sizebuf, "all");
+		}
+		else {
+		    h = &lat[i].size[t][c];
+		    if (lathist_size_class_max(c) < 0)
+			sprintf(sizebuf, ">%d", lathist_size_class_max(c-1));
+		    else
+			sprintf(sizebuf, "<=%d", lathist_size_class_max(c));
+		}
+		if (h->count == 0)
+		    continue;
+		printf("%9s%9s%10llu%8.0f%8.0f%8.0f%9.0f\n",
+		       (c < 0) ? opname[t] : "", sizebuf, h->count,
+		       lathist_quantile(h, 0.50) * ns,
+		       lathist_quantile(h, 0.99) * ns,
+		       lathist_quantile(h, 0.999) * ns,
+		       h->max * ns);
+	    }
+	}
+    }
+}
+
+/*
+ * printoverhead - prints the raw time of each trace next to the time
+ *     left after subtracting the null allocator replay, i.e. the time
+ *     spent in the allocator proper
+ */
+static void printoverhead(int n, stats_t *stats)
+{
+    int i;
+    double secs = 0, ovhd = 0, ops = 0;
+
+    printf("%5s%12s%12s%12s%8s%10s%11s\n",
+	   "trace", "raw secs", "harness", "alloc secs", "ovhd",
+	   "raw Kops", "alloc Kops");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%15s%12s%12s%8s%10s%11s\n",
+		   i, "-", "-", "-", "-", "-", "-");
+	    continue;
+	}
+	printf("%2d%15.6f%12.6f%12.6f%7.1f%%%10.0f%11.0f\n",
+	       i,
+	       stats[i].secs,
+	       stats[i].ovhd_secs,
+	       stats[i].secs - stats[i].ovhd_secs,
+	       100.0 * stats[i].ovhd_secs / stats[i].secs,
+	       (stats[i].ops/1e3) / stats[i].secs,
+	       (stats[i].ops/1e3) / (stats[i].secs - stats[i].ovhd_secs));
+	secs += stats[i].secs;
+	ovhd += stats[i].ovhd_secs;
+	ops += stats[i].ops;
+    }
+    if (secs > 0)
+	printf("%5s%12.6f%12.6f%12.6f%7.1f%%%10.0f%11.0f\n",
+	       "Total", secs, ovhd, secs - ovhd, 100.0 * ovhd / secs,
+	       (ops/1e3) / secs, (ops/1e3) / (secs - ovhd));
+}
+
+/*
+ * printcompare - prints the utilization and throughput of every package
+ *     selected with -A side by side, one row per trace
+ */
+static void printcompare(int n, stats_t **stats, double *perfindex)
+{
+    int i, a;
+    double secs, ops;
+
+    printf("\nSide-by-side results (util / Kops):\n%5s", "trace");
+    for (a = 0; a < num_allocs; a++)
+	printf("%16.16s", allocs[a]->name);
+    printf("\n");
+    for (i = 0; i < n; i++) {
+	printf("%2d   ", i);
+	for (a = 0; a < num_allocs; a++) {
+	    if (stats[a][i].valid)
+		printf("%8.0f%%%7.0f", stats[a][i].util * 100.0,
+		       (stats[a][i].ops/1e3) / stats[a][i].secs);
+	    else
+		printf("%16s", "-");
+	}
+	printf("\n");
+    }
+    printf("%5s", "Index");
+    for (a = 0; a < num_allocs; a++) {
+	secs = ops = 0;
+	for (i = 0; i < n; i++) {
+	    secs += stats[a][i].secs;
+	    ops += stats[a][i].ops;
+	}
+	printf("%9.0f%7.0f", perfindex[a], (ops/1e3) / secs);
+    }
+    printf("\n\n");
+}
+
+/*
+ * add_allocator - append one package to the list to evaluate
+ */
+static void add_allocator(const mm_allocator_t *a)
+{
+    allocs = realloc(allocs, (num_allocs + 1) * sizeof(*allocs));
+    if (allocs == NULL)
+	unix_error("realloc failed in add_allocator");
+    allocs[num_allocs++] = a;
+}
+
+/*
+ * add_allocators - append the comma-separated packages in arg to the
+ *     list to evaluate; "all" stands for every compiled-in package
+ */
+static void add_allocators(char *arg)
+{
+    char *name;
+    const mm_allocator_t *a;
+    int i;
+
+    for (name = strtok(arg, ","); name != NULL; name = strtok(NULL, ",")) {
+	if (!strcmp(name, "all")) {
+	    for (i = 0; i < mm_allocator_count(); i++)
+		add_allocator(mm_allocator_at(i));
+	    continue;
+	}
+	if ((a = mm_allocator_lookup(name)) == NULL) {
+	    sprintf(msg, "Unknown malloc package %s", name);
+	    app_error(msg);
+	}
+	add_allocator(a);
+    }
+}
+
+/*
+ * printrss - prints the brk-based utilization of each trace next to the
+ *     utilization measured against resident pages
+ */
+static void printrss(int n, stats_t *stats)
+{
+    int i;
+    double util = 0, rss_util = 0, rss_util_avg = 0;
+
+    printf("Resident memory utilization for %s:\n", mm->name);
+    printf("%5s%7s%11s%10s%10s\n",
+	   "trace", "util", "peak KB", "rss util", "avg util");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%9s%11s%10s%10s\n", i, "-", "-", "-", "-");
+	    continue;
+	}
+	printf("%2d%9.0f%%%10.0f%9.0f%%%9.0f%%\n",
+	       i,
+	       stats[i].util * 100.0,
+	       stats[i].rss_peak / 1024,
+	       stats[i].rss_util * 100.0,
+	       stats[i].rss_util_avg * 100.0);
+	util += stats[i].util;
+	rss_util += stats[i].rss_util;
+	rss_util_avg += stats[i].rss_util_avg;
+    }
+    if (errors == 0)
+	printf("%5s%6.0f%%%11s%9.0f%%%9.0f%%\n", "Total",
+	       (util/n) * 100.0, "", (rss_util/n) * 100.0,
+	       (rss_util_avg/n) * 100.0);
+}
+
+/*
+ * printfit - prints how many free blocks the package examined per
+ *     search for a fit, under each placement policy it used
+ */
+static void printfit(int n, stats_t *stats)
+{
+    static const char *fitnames[MM_FIT_POLICIES] =
+	{"first", "next", "best", "good"};
+    int i, p;
+    size_t searches;
+
+    printf("Free blocks examined per fit search by %s:\n", mm->name);
+    printf("%5s%11s", "trace", "searches");
+    for (p = 0; p < MM_FIT_POLICIES; p++)
+	printf("%8s", fitnames[p]);
+    printf("\n");
+    for (i = 0; i < n; i++) {
+	for (p = 0, searches = 0; p < MM_FIT_POLICIES; p++)
+	    searches += stats[i].heap.fit_searches[p];
+	printf("%2d%14lu", i, (unsigned long)searches);
+	for (p = 0; p < MM_FIT_POLICIES; p++) {
+	    if (stats[i].heap.fit_searches[p] == 0)
+		printf("%8s", "-");
+	    else
+		printf("%8.1f", (double)stats[i].heap.fit_examined[p] /
+		       stats[i].heap.fit_searches[p]);
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * printfaults - prints the minor page faults that the driver took in
+ *     the validity replay of each trace, which starts with no heap page
+ *     resident, and the heap extensions that the package reported
+ */
+static void printfaults(int n, stats_t *stats)
+{
+    int i;
+    long faults = 0;
+
+    printf("Page faults of a replay on a cold heap by %s:\n", mm->name);
+    printf("%5s%9s%9s%9s\n", "trace", "faults", "per Kop", "extends");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%12s%9s%9s\n", i, "-", "-", "-");
+	    continue;
+	}
+	printf("%2d%12ld%9.1f%9lu\n", i, stats[i].faults,
+	       stats[i].faults / (stats[i].ops / 1e3),
+	       (unsigned long)stats[i].heap.extends);
+	faults += stats[i].faults;
+    }
+    printf("%5s%9ld\n", "Total", faults);
+}
+
+/*
+ * minflt - minor page faults that the calling thread took so far
+ */
+static long minflt(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_minflt;
+}
+
+/*
+ * printtouch - prints the time and the cache and TLB misses per op of
+ *     the payload-touching replay of each trace
+ */
+static void printtouch(int n, stats_t *stats, speed_t *params)
+{
+    static const char *names[] = {"seq", "rev", "random"};
+    static const int events[] = {PERF_L1D_MISSES, PERF_LLC_MISSES,
+				 PERF_DTLB_MISSES, PERF_PAGE_FAULTS};
+    int nevents = sizeof(events) / sizeof(events[0]);
+    int i, e;
+
+    printf("Payload-touching replay for %s (%s sweeps every %d ops):\n",
+	   mm->name,
+	   names[params->touch_pattern], params->touch_interval);
+    printf("%5s%10s%6s", "trace", "secs", "Kops");
+    for (e = 0; e < nevents; e++)
+	printf("%11s", perf_event_name(events[e]));
+    printf("  (per op)\n");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%13s%6s\n", i, "-", "-");
+	    continue;
+	}
+	printf("%2d%13.6f%6.0f", i, stats[i].touch_secs,
+	       (stats[i].ops/1e3) / stats[i].touch_secs);
+	for (e = 0; e < nevents; e++) {
+	    if (stats[i].touch_perf.valid[events[e]])
+		printf("%11.3f", stats[i].touch_perf.value[events[e]] /
+		       stats[i].ops);
+	    else
+		printf("%11s", "-");
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * parse_touch - parse the -T argument "<pattern>[,<interval>]"
+ */
+static int parse_touch(char *arg, speed_t *params)
+{
+    char *comma = strchr(arg, ',');
+    int len = comma ? comma - arg : (int)strlen(arg);
+
+    if (!strncmp(arg, "seq", len) && len == 3)
+	params->touch_pattern = TOUCH_SEQ;
+    else if (!strncmp(arg, "rev", len) && len == 3)
+	params->touch_pattern = TOUCH_REV;
+    else if (!strncmp(arg, "random", len) && len == 6)
+	params->touch_pattern = TOUCH_RANDOM;
+    else
+	return -1;
+
+    params->touch_interval = comma ? atoi(comma + 1) : TOUCH_INTERVAL;
+    return (params->touch_interval > 0) ? 0 : -1;
+}
+
+/*
+ * parse_tune - parse the -U argument "<objective>[,<header>]"
+ */
+static int parse_tune(char *arg, int *objective, char **header)
+{
+    char *comma = strchr(arg, ',');
+    int len = comma ? comma - arg : (int)strlen(arg);
+
+    if (!strncmp(arg, "perf", len) && len == 4)
+	*objective = TUNE_PERF;
+    else if (!strncmp(arg, "p99", len) && len == 3)
+	*objective = TUNE_P99;
+    else if (!strncmp(arg, "rss", len) && len == 3)
+	*objective = TUNE_RSS;
+    else
+	return -1;
+
+    *header = (comma && comma[1]) ? comma + 1 : "mm_tuned.h";
+    return 0;
+}
+
+/*
+ * printperf - prints the event counts of one run of each trace, first
+ *     as totals and then normalized per malloc/free/realloc request
+ */
+static void printperf(int n, stats_t *stats)
+{
+    int i, e, pass;
+    double total[PERF_NEVENTS];
+    double ops = 0;
+
+    for (pass = 0; pass < 2; pass++) {
+	printf("%5s", "trace");
+	for (e = 0; e < PERF_NEVENTS; e++)
+	    printf("%11s", perf_event_name(e));
+	printf("  %s\n", pass ? "(per op)" : "(total)");
+
+	for (e = 0; e < PERF_NEVENTS; e++)
+	    total[e] = 0;
+	ops = 0;
+	for (i = 0; i < n; i++) {
+	    printf("%2d   ", i);
+	    for (e = 0; e < PERF_NEVENTS; e++) {
+		if (!stats[i].valid || !stats[i].perf.valid[e]) {
+		    printf("%11s", "-");
+		    continue;
+		}
+		total[e] += stats[i].perf.value[e];
+		if (pass)
+		    printf("%11.2f", stats[i].perf.value[e] / stats[i].ops);
+		else
+		    printf("%11llu", stats[i].perf.value[e]);
+	    }
+	    printf("\n");
+	    if (stats[i].valid)
+		ops += stats[i].ops;
+	}
+
+	printf("%5s", "Total");
+	for (e = 0; e < PERF_NEVENTS; e++) {
+	    if (!perf_event_available(e))
+		printf("%11s", "-");
+	    else if (pass)
+		printf("%11.2f", ops > 0 ? total[e] / ops : 0.0);
+	    else
+		printf("%11.0f", total[e]);
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * The columns written by writecsv, in order, and read back by
+ * compare_baseline. Latency quantiles are in nanoseconds.
+ */
+static const char *opnames[3] = {"malloc", "free", "realloc"};
+static const char *latnames[4] = {"p50", "p99", "p999", "max"};
+static const double latq[3] = {0.50, 0.99, 0.999};
+
+/* latency quantile k of histogram h in nanoseconds (k == 3 is max) */
+static double lat_ns(lathist_t *h, int k)
+{
+    double ns = 1e9 / cycles_hz();
+
+    return (k < 3 ? lathist_quantile(h, latq[k]) : h->max) * ns;
+}
+
+/* json_string - writes s as a JSON string, escaping what JSON requires */
+static void json_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+	if (*s == '"' || *s == '\\')
+	    fprintf(fp, "\\%c", *s);
+	else if ((unsigned char)*s < 0x20)
+	    fprintf(fp, "\\u%04x", (unsigned char)*s);
+	else
+	    fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * json_measured - writes one "name": value member in format fmt, or
+ *     null if measured is not set
+ */
+static void json_measured(FILE *fp, const char *name, const char *fmt,
+			  double v, int measured)
+{
+    fprintf(fp, "      \"%s\": ", name);
+    if (measured)
+	fprintf(fp, fmt, v);
+    else
+	fprintf(fp, "null");
+    fprintf(fp, ",\n");
+}
+
+/*
+ * writejson - writes every field of the stats of each trace, and the
+ *     latency quantiles if they were measured, as one JSON object in
+ *     the "allocators" array. Values that were not measured are null;
+ *     the stats start out zeroed, and a measured time or peak RSS is
+ *     never zero.
+ */
+static void writejson(FILE *fp, int n, char **names, stats_t *stats,
+		      latency_t *lat, double perfindex, int first)
+{
+    int i, e, t, k;
+    stats_t *st;
+    ftimer_stats_t *tm;
+
+    fprintf(fp, "%s  {\n  \"allocator\": ", first ? "" : ",\n");
+    json_string(fp, mm->name);
+    fprintf(fp, ",\n");
+    fprintf(fp, "  \"perfindex\": %.2f,\n  \"errors\": %d,\n",
+	    perfindex, errors);
+    fprintf(fp, "  \"traces\": [\n");
+    for (i = 0; i < n; i++) {
+	st = &stats[i];
+	tm = &st->timing;
+	fprintf(fp, "    {\n      \"trace\": %d,\n      \"name\": ", i);
+	json_string(fp, names[i]);
+	fprintf(fp, ",\n");
+	fprintf(fp, "      \"valid\": %d,\n      \"ops\": %.0f,\n",
+		st->valid, st->ops);
+	if (!st->valid) {
+	    fprintf(fp, "      \"secs\": null\n    }%s\n",
+		    (i < n - 1) ? "," : "");
+	    continue;
+	}
+	fprintf(fp, "      \"secs\": %.9f,\n      \"kops\": %.3f,\n",
+		st->secs, (st->ops/1e3) / st->secs);
+	fprintf(fp, "      \"timing\": {\"n\": %d, \"median\": %.9f, "
+		"\"mad\": %.9f, \"ci_lo\": %.9f, \"ci_hi\": %.9f, "
+		"\"min\": %.9f, \"mean\": %.9f},\n",
+		tm->n, tm->median, tm->mad, tm->ci_lo, tm->ci_hi,
+		tm->min, tm->mean);
+	fprintf(fp, "      \"util\": %.6f,\n", st->util);
+	json_measured(fp, "ovhd_secs", "%.9f", st->ovhd_secs,
+		      st->ovhd_secs > 0);
+	json_measured(fp, "touch_secs", "%.9f", st->touch_secs,
+		      st->touch_secs > 0);
+	json_measured(fp, "rss_peak", "%.0f", st->rss_peak, st->rss_peak > 0);
+	json_measured(fp, "rss_util", "%.6f", st->rss_util, st->rss_peak > 0);
+	json_measured(fp, "rss_util_avg", "%.6f", st->rss_util_avg,
+		      st->rss_peak > 0);
+	fprintf(fp, "      \"faults\": %ld,\n", st->faults);
+	fprintf(fp, "      \"heap\": {\"heap_bytes\": %lu, "
+		"\"alloc_bytes\": %lu, \"alloc_blocks\": %lu, "
+		"\"free_bytes\": %lu, \"free_blocks\": %lu, "
+		"\"largest_free\": %lu},\n",
+		(unsigned long)st->heap.heap_bytes,
+		(unsigned long)st->heap.alloc_bytes,
+		(unsigned long)st->heap.alloc_blocks,
+		(unsigned long)st->heap.free_bytes,
+		(unsigned long)st->heap.free_blocks,
+		(unsigned long)st->heap.largest_free);
+	for (k = 0; k < 2; k++) {
+	    perf_counts_t *pc = k ? &st->touch_perf : &st->perf;
+	    fprintf(fp, "      \"%s\": {", k ? "touch_perf" : "perf");
+	    for (e = 0; e < PERF_NEVENTS; e++) {
+		fprintf(fp, "%s\"%s\": ", e ? ", " : "", perf_event_name(e));
+		if (pc->valid[e])
+		    fprintf(fp, "%llu", pc->value[e]);
+		else
+		    fprintf(fp, "null");
+	    }
+	    fprintf(fp, "}%s\n", (k == 0 || lat) ? "," : "");
+	}
+	if (lat) {
+	    fprintf(fp, "      \"latency_ns\": {\n");
+	    for (t = 0; t < 3; t++) {
+		fprintf(fp, "        \"%s\": {\"count\": %llu",
+			opnames[t], lat[i].op[t].count);
+		for (k = 0; k < 4; k++)
+		    fprintf(fp, ", \"%s\": %.1f", latnames[k],
+			    lat_ns(&lat[i].op[t], k));
+		fprintf(fp, "}%s\n", (t < 2) ? "," : "");
+	    }
+	    fprintf(fp, "      }\n");
+	}
+	fprintf(fp, "    }%s\n", (i < n - 1) ? "," : "");
+    }
+    fprintf(fp, "  ]\n  }");
+}
+
+/*
+ * csv_measured - writes one field in format fmt, left empty if measured
+ *     is not set (see writejson)
+ */
+static void csv_measured(FILE *fp, const char *fmt, double v, int measured)
+{
+    fputc(',', fp);
+    if (measured)
+	fprintf(fp, fmt, v);
+}
+
+/*
+ * writecsv - writes one row per trace with every field of its stats
+ *     and, if measured, the latency quantiles, preceded by the column
+ *     names if header is set. Unmeasured values are left empty. The
+ *     output can serve as a baseline for -B.
+ */
+static void writecsv(FILE *fp, int n, char **names, stats_t *stats,
+		     latency_t *lat, int header)
+{
+    int i, e, t, k;
+    stats_t *st;
+    ftimer_stats_t *tm;
+
+    if (header) {
+	fprintf(fp, "allocator,trace,name,valid,ops,secs,kops,secs_n,"
+		"secs_median,secs_mad,secs_ci_lo,secs_ci_hi,secs_min,"
+		"secs_mean,util,ovhd_secs,touch_secs,rss_peak,rss_util,"
+		"rss_util_avg,faults,heap_bytes,alloc_bytes,alloc_blocks,"
+		"free_bytes,free_blocks,largest_free");
+	for (k = 0; k < 2; k++)
+	    for (e = 0; e < PERF_NEVENTS; e++)
+		fprintf(fp, ",%s%s", k ? "touch_" : "", perf_event_name(e));
+	for (t = 0; t < 3; t++)
+	    for (k = 0; k < 4; k++)
+		fprintf(fp, ",%s_%s_ns", opnames[t], latnames[k]);
+	fprintf(fp, "\n");
+    }
+
+    for (i = 0; i < n; i++) {
+	st = &stats[i];
+	tm = &st->timing;
+	fprintf(fp, "%s,%d,%s,%d,%.0f", mm->name, i, names[i], st->valid,
+		st->ops);
+	if (!st->valid) {
+	    fprintf(fp, "\n");
+	    continue;
+	}
+	fprintf(fp, ",%.9f,%.3f,%d,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.6f",
+		st->secs, (st->ops/1e3) / st->secs, tm->n, tm->median,
+		tm->mad, tm->ci_lo, tm->ci_hi, tm->min, tm->mean, st->util);
+	csv_measured(fp, "%.9f", st->ovhd_secs, st->ovhd_secs > 0);
+	csv_measured(fp, "%.9f", st->touch_secs, st->touch_secs > 0);
+	csv_measured(fp, "%.0f", st->rss_peak, st->rss_peak > 0);
+	csv_measured(fp, "%.6f", st->rss_util, st->rss_peak > 0);
+	csv_measured(fp, "%.6f", st->rss_util_avg, st->rss_peak > 0);
+	fprintf(fp, ",%ld", st->faults);
+	fprintf(fp, ",%lu,%lu,%lu,%lu,%lu,%lu",
+		(unsigned long)st->heap.heap_bytes,
+		(unsigned long)st->heap.alloc_bytes,
+		(unsigned long)st->heap.alloc_blocks,
+		(unsigned long)st->heap.free_bytes,
+		(unsigned long)st->heap.free_blocks,
+		(unsigned long)st->heap.largest_free);
+	for (k = 0; k < 2; k++) {
+	    perf_counts_t *pc = k ? &st->touch_perf : &st->perf;
+	    for (e = 0; e < PERF_NEVENTS; e++) {
+		if (pc->valid[e])
+		    fprintf(fp, ",%llu", pc->value[e]);
+		else
+		    fprintf(fp, ",");
+	    }
+	}
+	for (t = 0; t < 3; t++)
+	    for (k = 0; k < 4; k++) {
+		if (lat)
+		    fprintf(fp, ",%.1f", lat_ns(&lat[i].op[t], k));
+		else
+		    fprintf(fp, ",");
+	    }
+	fprintf(fp, "\n");
+    }
+}
+
+/*
+ * split_csv - split a CSV line in place into at most max fields and
+ *     return the number of fields
+ */
+static int split_csv(char *line, char **fields, int max)
+{
+    int n = 0;
+    char *p = line;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    while (n < max) {
+	fields[n++] = p;
+	if ((p = strchr(p, ',')) == NULL)
+	    break;
+	*p++ = '\0';
+    }
+    return n;
+}
+
+/*
+ * compare_baseline - compares each trace with the row of the same name
+ *     (and allocator) in a CSV file written by -c, prints a report and
+ *     returns the number of traces that regressed. Throughput regresses
+ *     when the new median time is more than REGRESS_THRU_TOL above the
+ *     baseline and the two 95% confidence intervals are disjoint, so
+ *     that noise alone does not fail the gate; utilization regresses
+ *     when it drops by more than REGRESS_UTIL_TOL.
+ */
+static int compare_baseline(char *path, int n, char **names, stats_t *stats)
+{
+    enum {C_NAME, C_VALID, C_SECS, C_CI_LO, C_CI_HI, C_UTIL, C_ALLOC,
+	  C_NCOLS};
+    static const char *colnames[C_NCOLS] =
+	{"name", "valid", "secs", "secs_ci_lo", "secs_ci_hi", "util",
+	 "allocator"};
+    int col[C_NCOLS];
+    char line[CSVLINE], *fields[256];
+    int nfields, i, c, found, regressions = 0;
+    double bsecs, blo, bhi, butil, change;
+    const char *verdict;
+    FILE *fp;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open baseline %s", path);
+	unix_error(msg);
+    }
+    if (fgets(line, CSVLINE, fp) == NULL)
+	app_error("Empty baseline file");
+    nfields = split_csv(line, fields, 256);
+    for (c = 0; c < C_NCOLS; c++) {
+	col[c] = -1;
+	for (i = 0; i < nfields; i++)
+	    if (!strcmp(fields[i], colnames[c]))
+		col[c] = i;
+	if (col[c] < 0 && c != C_ALLOC) {
+	    sprintf(msg, "Baseline %s has no %s column", path, colnames[c]);
+	    app_error(msg);
+	}
+    }
+
+    printf("Comparison of %s with baseline %s:\n", mm->name, path);
+    printf("%5s %-20s%10s%10s%8s%8s%8s  %s\n", "trace", "name",
+	   "base Kops", "Kops", "change", "base", "util", "verdict");
+    for (i = 0; i < n; i++) {
+	found = 0;
+	rewind(fp);
+	fgets(line, CSVLINE, fp);
+	while (fgets(line, CSVLINE, fp) != NULL) {
+	    nfields = split_csv(line, fields, 256);
+	    if (nfields > col[C_UTIL] && nfields > col[C_CI_HI] &&
+		!strcmp(fields[col[C_NAME]], names[i]) &&
+		(col[C_ALLOC] < 0 || !strcmp(fields[col[C_ALLOC]], mm->name)) &&
+		atoi(fields[col[C_VALID]])) {
+		found = 1;
+		break;
+	    }
+	}
+	if (!found || !stats[i].valid) {
+	    printf("%2d    %-20s%10s%10s%8s%8s%8s  %s\n", i, names[i],
+		   "-", "-", "-", "-", "-",
+		   stats[i].valid ? "no baseline" : "INVALID");
+	    if (!stats[i].valid)
+		regressions++;
+	    continue;
+	}
+	bsecs = atof(fields[col[C_SECS]]);
+	blo = atof(fields[col[C_CI_LO]]);
+	bhi = atof(fields[col[C_CI_HI]]);
+	butil = atof(fields[col[C_UTIL]]);
+	change = bsecs / stats[i].secs - 1.0;  /* throughput change */
+
+	verdict = "ok";
+	if (stats[i].util < butil - REGRESS_UTIL_TOL) {
+	    verdict = "UTIL REGRESSION";
+	    regressions++;
+	}
+	else if (stats[i].secs > bsecs * (1 + REGRESS_THRU_TOL) &&
+		 stats[i].timing.ci_lo > bhi) {
+	    verdict = "THRU REGRESSION";
+	    regressions++;
+	}
+	else if (stats[i].secs < bsecs * (1 - REGRESS_THRU_TOL) &&
+		 stats[i].timing.ci_hi < blo) {
+	    verdict = "faster";
+	}
+	printf("%2d    %-20s%10.0f%10.0f%7.1f%%%7.1f%%%7.1f%%  %s\n",
+	       i, names[i], (stats[i].ops/1e3) / bsecs,
+	       (stats[i].ops/1e3) / stats[i].secs, change * 100.0,
+	       butil * 100.0, stats[i].util * 100.0, verdict);
+    }
+    fclose(fp);
+    return regressions;
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1005,14 +2633,36 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hHvValLPOR] [-f <file>] [-t <dir>] "
+	    "[-T <pattern>[,<n>]] [-F <csv>[,<n>]]\n"
+	    "               [-j <json>] [-c <csv>] [-B <baseline csv>] "
+	    "[-A <pkg>[,<pkg>...]]\n"
+	    "               [-U <objective>[,<header>]] [-W <kb>[,thread]]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-A <pkgs>  Evaluate these malloc packages side by side:\n"
+	    "\t           compiled-in names, \"all\", or [name=]path.so.\n");
+    fprintf(stderr, "\t-B <csv>   Fail if worse than a baseline written by -c.\n");
+    fprintf(stderr, "\t-c <csv>   Write all results as CSV.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F <csv>[,n] Write heap fragmentation every n ops "
+	    "to <csv>.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Ignore the lifetime hints in traces.\n");
+    fprintf(stderr, "\t-j <json>  Write all results as JSON.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Print per-op latency percentiles.\n");
+    fprintf(stderr, "\t-O         Print times net of the driver's own overhead.\n");
+    fprintf(stderr, "\t-P         Print hardware and software event counts.\n");
+    fprintf(stderr, "\t-R         Print utilization against resident pages.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <p>[,n] Also replay writing each payload and reading\n"
+	    "\t           n live blocks every n ops; p is seq, rev or random.\n");
+    fprintf(stderr, "\t-U <o>[,h] Tune the parameters of mm.c for objective o\n"
+	    "\t           (perf, p99 or rss) and write them to header h.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-W <k>[,t] Keep k KB beyond brk faulted in, on a "
+	    "helper\n\t           thread if t is \"thread\".\n");
 }
@@ -3,13 +3,17 @@
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE  /* memfd_create, file seals and MADV_POPULATE_WRITE */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
@@ -19,19 +23,207 @@ static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
 
+/*
+ * A heap file starts with a page that holds this header, followed by
+ * the heap. The header keeps the brk for the next process.
+ */
+#define MEM_FILE_MAGIC 0x6d6d6866UL
+
+typedef struct {
+    unsigned long magic;
+    size_t brk;              /* heap size */
+} mem_file_t;
+
+static mem_file_t *mem_file; /* header of a file-backed heap, else NULL */
+static int mem_file_shared;  /* whether the file is mapped MAP_SHARED */
+
+/*
+ * Run-ahead pre-faulting (mem_set_runahead). The pages below
+ * mem_fault_brk are faulted in, or queued for the helper thread, which
+ * faults in [lo, hi) outside of the lock.
+ */
+static size_t mem_runahead;  /* bytes kept faulted in beyond brk, 0 = off */
+static char *mem_fault_brk;  /* end of the pages faulted in */
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int running;
+    int stop;
+    char *lo, *hi;           /* pages left to fault in */
+} mem_helper = {.lock = PTHREAD_MUTEX_INITIALIZER,
+		.wake = PTHREAD_COND_INITIALIZER};
+
+static void mem_run_ahead(void);
+static void *mem_helper_main(void *arg);
+static void mem_stop_helper(void);
+static void mem_fork_prepare(void);
+static void mem_fork_parent(void);
+static void mem_fork_child(void);
+
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* 
+     * Map the storage we will use to model the available VM. It comes
+     * straight from mmap so that its pages stay nonresident until the
+     * allocator touches them, which mem_resident() relies on. Huge
+     * pages are disabled to keep residency at base page granularity.
+     */
+    mem_start_brk = (char *)mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
+#ifdef MADV_NOHUGEPAGE
+    madvise(mem_start_brk, MAX_HEAP, MADV_NOHUGEPAGE);
+#endif
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_fault_brk = mem_brk;
+}
+
+/*
+ * mem_map_fd - map the heap file fd at MEM_FILE_ADDR, over the heap
+ *    file mapped before if there is one. Returns 1 if it held a heap,
+ *    whose brk is restored, or 0 after making it an empty heap. what
+ *    names the file in errors.
+ */
+static int mem_map_fd(int fd, int flags, const char *what)
+{
+    size_t pagesize = mem_pagesize();
+    size_t len = pagesize + MAX_HEAP;
+    char *map;
+
+    if (mem_file != NULL)
+	flags |= MAP_FIXED;
+    map = mmap(MEM_FILE_ADDR, len, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (map == MAP_FAILED || map != (char *)MEM_FILE_ADDR) {
+	fprintf(stderr, "mem_map_fd: could not map %s at %p\n", what,
+		MEM_FILE_ADDR);
+	exit(1);
+    }
+#ifdef MADV_NOHUGEPAGE
+    madvise(map, len, MADV_NOHUGEPAGE);
+#endif
+
+    mem_file = (mem_file_t *)map;
+    mem_file_shared = (flags & MAP_SHARED) != 0;
+    mem_start_brk = map + pagesize;
+    mem_max_addr = mem_start_brk + MAX_HEAP;
+    mem_fault_brk = mem_start_brk;
+    if (mem_file->magic == MEM_FILE_MAGIC && mem_file->brk <= MAX_HEAP) {
+	mem_brk = mem_start_brk + mem_file->brk;
+	return 1;
+    }
+    mem_file->magic = MEM_FILE_MAGIC;
+    mem_file->brk = 0;
+    mem_brk = mem_start_brk;
+    return 0;
+}
+
+/*
+ * mem_init_file - initialize the memory system model with a heap that
+ *    is kept in the file at path, mapped at MEM_FILE_ADDR. Returns 1 if
+ *    the file held a heap, whose brk is restored, or 0 if it was
+ *    created or empty and the heap starts out empty.
+ */
+int mem_init_file(const char *path)
+{
+    size_t len = mem_pagesize() + MAX_HEAP;
+    struct stat st;
+    int fd, warm;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0 || fstat(fd, &st) < 0) {
+	fprintf(stderr, "mem_init_file: could not open %s\n", path);
+	exit(1);
+    }
+    if (st.st_size != 0 && (size_t)st.st_size != len) {
+	fprintf(stderr, "mem_init_file: %s is not a heap file\n", path);
+	exit(1);
+    }
+    if (st.st_size == 0 && ftruncate(fd, len) < 0) {
+	fprintf(stderr, "mem_init_file: could not size %s\n", path);
+	exit(1);
+    }
+    warm = mem_map_fd(fd, MAP_SHARED, path);
+    close(fd);
+    return warm;
+}
+
+/*
+ * mem_init_memfd - initialize the memory system model with an empty
+ *    heap laid out like a heap file but kept in an anonymous memory
+ *    file, so that the allocator keeps its roots in the heap and the
+ *    heap can be copied by mem_snapshot
+ */
+void mem_init_memfd(void)
+{
+    int fd;
+
+    if ((fd = memfd_create("mm-heap", 0)) < 0 ||
+	ftruncate(fd, mem_pagesize() + MAX_HEAP) < 0) {
+	fprintf(stderr, "mem_init_memfd: could not create the heap\n");
+	exit(1);
+    }
+    mem_map_fd(fd, MAP_SHARED, "memfd");
+    close(fd);
+}
+
+/*
+ * mem_snapshot - copy a file-backed heap, with its header, into a new
+ *    sealed memory file and return its descriptor, or -1 if the heap
+ *    is not file-backed. Other processes map the copy with
+ *    mem_init_snapshot.
+ */
+int mem_snapshot(void)
+{
+    size_t used = mem_pagesize() + mem_heapsize();
+    size_t done = 0;
+    ssize_t n;
+    int fd;
+
+    if (mem_file == NULL)
+	return -1;
+    if ((fd = memfd_create("mm-snapshot", MFD_ALLOW_SEALING)) < 0 ||
+	ftruncate(fd, mem_pagesize() + MAX_HEAP) < 0) {
+	fprintf(stderr, "mem_snapshot: could not create the snapshot\n");
+	exit(1);
+    }
+    while (done < used) {
+	if ((n = pwrite(fd, (char *)mem_file + done, used - done, done)) <= 0) {
+	    fprintf(stderr, "mem_snapshot: could not write the snapshot\n");
+	    exit(1);
+	}
+	done += n;
+    }
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE |
+	  F_SEAL_SEAL);
+    return fd;
+}
+
+/*
+ * mem_init_snapshot - initialize the memory system model with a private
+ *    copy-on-write mapping of the snapshot fd made by mem_snapshot:
+ *    pages are shared with every other process that maps it until
+ *    they are first written. Returns 1 if the snapshot holds a heap.
+ */
+int mem_init_snapshot(int fd)
+{
+    return mem_map_fd(fd, MAP_PRIVATE, "snapshot");
+}
+
+/*
+ * mem_persistent - whether the heap is kept in a file
+ */
+int mem_persistent(void)
+{
+    return mem_file != NULL;
 }
 
 /* 
@@ -39,7 +231,13 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_stop_helper();
+    if (mem_file != NULL) {
+	munmap(mem_file, mem_pagesize() + MAX_HEAP);
+	mem_file = NULL;
+	return;
+    }
+    munmap(mem_start_brk, MAX_HEAP);
 }
 
 /*
@@ -48,26 +246,158 @@ void mem_deinit(void)
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    if (mem_file != NULL)
+	mem_file->brk = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap and returns the old brk.
  */
 void *mem_sbrk(int incr) 
 {
     char *old_brk = mem_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if ((mem_brk + incr < mem_start_brk) || (mem_brk + incr > mem_max_addr)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
     mem_brk += incr;
+    if (mem_file != NULL)
+	mem_file->brk = mem_brk - mem_start_brk;
+    if (mem_runahead > 0 && mem_brk + mem_runahead / 2 > mem_fault_brk)
+	mem_run_ahead();
     return (void *)old_brk;
 }
 
+/*
+ * mem_set_runahead - keep the bytes beyond brk faulted in, so that the
+ *    allocator hands out pages that take no fault when they are first
+ *    written: whenever brk comes within half of that of the pages
+ *    faulted in, mem_sbrk faults in the pages up to bytes beyond brk.
+ *    With thread set, a helper thread does that instead of the caller
+ *    of mem_sbrk; a child forked meanwhile has no helper and faults in
+ *    the pages itself. 0 bytes turns run-ahead off.
+ */
+void mem_set_runahead(size_t bytes, int thread)
+{
+    static int atfork = 0;
+    size_t pagesize = mem_pagesize();
+
+    mem_stop_helper();
+    mem_runahead = (bytes + pagesize - 1) & ~(pagesize - 1);
+    mem_fault_brk = mem_brk;
+    if (mem_runahead == 0)
+	return;
+    if (thread) {
+	if (!atfork && pthread_atfork(mem_fork_prepare, mem_fork_parent,
+				      mem_fork_child) == 0)
+	    atfork = 1;
+	mem_helper.stop = 0;
+	mem_helper.lo = mem_helper.hi = NULL;
+	if (pthread_create(&mem_helper.thread, NULL, mem_helper_main,
+			   NULL) != 0) {
+	    fprintf(stderr, "mem_set_runahead: could not create the helper "
+		    "thread, faulting in pages inline\n");
+	} else
+	    mem_helper.running = 1;
+    }
+    mem_run_ahead();
+}
+
+/*
+ * mem_run_ahead - fault in, or have the helper thread fault in, the
+ *    pages from the last ones faulted in up to mem_runahead beyond brk
+ */
+static void mem_run_ahead(void)
+{
+    char *lo = mem_fault_brk;
+    char *hi = mem_brk + mem_runahead;
+
+    if (hi > mem_max_addr)
+	hi = mem_max_addr;
+    if (hi <= lo)
+	return;
+    mem_fault_brk = hi;
+    if (!mem_helper.running) {
+	mem_prefault(lo, hi - lo);
+	return;
+    }
+    pthread_mutex_lock(&mem_helper.lock);
+    if (mem_helper.lo == mem_helper.hi || lo < mem_helper.lo)
+	mem_helper.lo = lo;
+    mem_helper.hi = hi;
+    pthread_cond_signal(&mem_helper.wake);
+    pthread_mutex_unlock(&mem_helper.lock);
+}
+
+/*
+ * mem_helper_main - the helper thread, which faults in the pages that
+ *    mem_run_ahead queues
+ */
+static void *mem_helper_main(void *arg)
+{
+    char *lo, *hi;
+
+    pthread_mutex_lock(&mem_helper.lock);
+    while (!mem_helper.stop) {
+	if (mem_helper.lo == mem_helper.hi) {
+	    pthread_cond_wait(&mem_helper.wake, &mem_helper.lock);
+	    continue;
+	}
+	lo = mem_helper.lo;
+	hi = mem_helper.hi;
+	mem_helper.lo = mem_helper.hi;
+	pthread_mutex_unlock(&mem_helper.lock);
+	mem_prefault(lo, hi - lo);
+	pthread_mutex_lock(&mem_helper.lock);
+    }
+    pthread_mutex_unlock(&mem_helper.lock);
+    return arg;
+}
+
+/*
+ * mem_stop_helper - stop the helper thread, if it runs
+ */
+static void mem_stop_helper(void)
+{
+    if (!mem_helper.running)
+	return;
+    pthread_mutex_lock(&mem_helper.lock);
+    mem_helper.stop = 1;
+    pthread_cond_signal(&mem_helper.wake);
+    pthread_mutex_unlock(&mem_helper.lock);
+    pthread_join(mem_helper.thread, NULL);
+    mem_helper.running = 0;
+}
+
+/*
+ * mem_fork_prepare, mem_fork_parent, mem_fork_child - hold the helper's
+ *    lock across fork, so that the child gets it in a known state. The
+ *    child has no helper thread: it drops the pages still queued and
+ *    faults in pages inline from the first of them.
+ */
+static void mem_fork_prepare(void)
+{
+    pthread_mutex_lock(&mem_helper.lock);
+}
+
+static void mem_fork_parent(void)
+{
+    pthread_mutex_unlock(&mem_helper.lock);
+}
+
+static void mem_fork_child(void)
+{
+    if (mem_helper.lo != mem_helper.hi)
+	mem_fault_brk = mem_helper.lo;
+    mem_helper.lo = mem_helper.hi = NULL;
+    mem_helper.running = 0;
+    pthread_mutex_unlock(&mem_helper.lock);
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -99,3 +429,106 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_release - give the whole pages inside [addr, addr+len) back to
+ *    the OS. Their contents are lost and they read as zero afterwards
+ *    (as the snapshot for a heap mapped from one), but they remain
+ *    part of the heap. For a heap in a file or memory file the pages
+ *    are punched out of the file, since dropping only the mapping
+ *    would leave them in the page cache. Releasing pages that run-ahead faulted in,
+ *    beyond brk or at the top of a heap about to shrink, makes it fault
+ *    them in again. Returns the bytes released.
+ */
+size_t mem_release(void *addr, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    size_t lo = ((size_t)addr + pagesize - 1) & ~(pagesize - 1);
+    size_t hi = ((size_t)addr + len) & ~(pagesize - 1);
+
+    if ((char *)addr < mem_start_brk || (char *)addr + len > mem_max_addr ||
+	hi <= lo)
+	return 0;
+    if (madvise((void *)lo, hi - lo,
+		(mem_file != NULL && mem_file_shared) ? MADV_REMOVE :
+		MADV_DONTNEED) < 0)
+	return 0;
+    /*
+     * A range that reaches brk is the top of the heap, which the
+     * allocator is about to give back, or pages beyond it: either way
+     * run-ahead has to fault in again from lo
+     */
+    if ((char *)lo < mem_fault_brk && (char *)addr + len >= mem_brk) {
+	mem_fault_brk = (char *)lo;
+	if (mem_helper.running) {
+	    pthread_mutex_lock(&mem_helper.lock);
+	    mem_helper.lo = mem_helper.hi;
+	    pthread_mutex_unlock(&mem_helper.lock);
+	}
+    }
+    return hi - lo;
+}
+
+/*
+ * mem_prefault - fault in the pages that overlap [addr, addr+len) for
+ *    writing without changing their contents, so that the first stores
+ *    to them take no page fault. Another thread may be using the range
+ *    meanwhile. Returns the bytes prefaulted.
+ */
+size_t mem_prefault(void *addr, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    size_t lo = (size_t)addr & ~(pagesize - 1);
+    size_t hi = ((size_t)addr + len + pagesize - 1) & ~(pagesize - 1);
+    size_t p;
+
+    if ((char *)addr < mem_start_brk || (char *)addr + len > mem_max_addr ||
+	hi <= lo)
+	return 0;
+#ifdef MADV_POPULATE_WRITE
+    if (madvise((void *)lo, hi - lo, MADV_POPULATE_WRITE) == 0)
+	return hi - lo;
+#endif
+    /* Older kernels: an atomic no-op store to every page */
+    for (p = lo; p < hi; p += pagesize)
+	__sync_fetch_and_or((int *)p, 0);
+    return hi - lo;
+}
+
+/*
+ * mem_resident - returns the number of bytes of the heap that are
+ *    currently backed by physical pages
+ */
+size_t mem_resident(void)
+{
+    size_t pagesize = mem_pagesize();
+    size_t npages = (mem_heapsize() + pagesize - 1) / pagesize;
+
+    return mem_resident_in(mem_start_brk, npages * pagesize);
+}
+
+/*
+ * mem_resident_in - returns the number of bytes of the whole pages
+ *    inside [addr, addr+len), the ones mem_release would give back,
+ *    that are currently backed by physical pages. Safe to call from
+ *    any thread.
+ */
+size_t mem_resident_in(void *addr, size_t len)
+{
+    unsigned char vec[1024];
+    size_t pagesize = mem_pagesize();
+    size_t lo = ((size_t)addr + pagesize - 1) & ~(pagesize - 1);
+    size_t hi = ((size_t)addr + len) & ~(pagesize - 1);
+    size_t i, n, resident = 0;
+
+    for (; lo < hi; lo += n * pagesize) {
+	n = (hi - lo) / pagesize;
+	if (n > sizeof(vec))
+	    n = sizeof(vec);
+	if (mincore((void *)lo, n * pagesize, vec) < 0)
+	    return resident + (hi - lo);
+	for (i = 0; i < n; i++)
+	    resident += (vec[i] & 1) * pagesize;
+    }
+    return resident;
+}
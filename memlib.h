@@ -1,6 +1,11 @@
 #include <unistd.h>
 
 void mem_init(void);               
+int mem_init_file(const char *path);
+void mem_init_memfd(void);
+int mem_snapshot(void);
+int mem_init_snapshot(int fd);
+int mem_persistent(void);
 void mem_deinit(void);
 void *mem_sbrk(int incr);
 void mem_reset_brk(void); 
@@ -8,4 +13,9 @@ void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+size_t mem_release(void *addr, size_t len);
+size_t mem_prefault(void *addr, size_t len);
+void mem_set_runahead(size_t bytes, int thread);
+size_t mem_resident(void);
+size_t mem_resident_in(void *addr, size_t len);
 
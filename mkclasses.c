@@ -0,0 +1,34 @@
+/*
+ * mkclasses.c - Build the size-class header for mm.c from a profile
+ *
+ * usage: mkclasses <profile> <header>
+ *
+ * Run by make when PROFILE is set; see sizeclass.h for the profile
+ * format.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sizeclass.h"
+
+int main(int argc, char **argv)
+{
+    sc_profile_t prof;
+    size_t limits[2 * SC_MAX];
+    FILE *fp;
+    int n;
+
+    if (argc != 3) {
+	fprintf(stderr, "Usage: mkclasses <profile> <header>\n");
+	exit(1);
+    }
+    sc_read_profile(argv[1], &prof);
+    n = sc_limits(&prof, limits);
+    if ((fp = fopen(argv[2], "w")) == NULL) {
+	fprintf(stderr, "mkclasses: could not create %s\n", argv[2]);
+	exit(1);
+    }
+    sc_write_header(fp, limits, n, prof.lut, argv[1]);
+    fclose(fp);
+    exit(0);
+}
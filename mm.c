@@ -12,12 +12,18 @@
 #include "mm.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "memlib.h"
+#include "mm_buddy.h"
+#ifdef MM_SIDE_META
+#include "config.h"
+#endif
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -45,8 +51,74 @@ team_t team = {
 
 #define WSIZE        sizeof(void *)
 #define DSIZE        (2 * WSIZE)
+
+/* Size classes from a profile (make PROFILE=...) or tracestat -c */
+#ifdef MM_CLASSES
+#include MM_CLASSES
+#endif
+
+/* Parameters chosen by mdriver -U (make MM_TUNED=...) */
+#ifdef MM_TUNED
+#include MM_TUNED
+#endif
+
+/*
+ * Tunables, which a VARIANTS build may override with -D. They are the
+ * defaults of the run-time configuration, see mm_config().
+ */
+#ifndef CHUNKSIZE
 #define CHUNKSIZE    (1 << 12) /* Extend heap by this amount (bytes) */
-#define SEG_LIST_LEN 20
+#endif
+#ifndef SEG_LIST_LEN
+#define SEG_LIST_LEN 20        /* Free lists in use */
+#endif
+#ifndef BIN_SUB
+#define BIN_SUB      0         /* log2 of free lists per power of two */
+#endif
+#ifndef SPLIT_MIN
+#define SPLIT_MIN    (2 * DSIZE) /* Smallest remainder place() splits off */
+#endif
+#ifndef FIT_LIMIT
+#define FIT_LIMIT    0         /* Free blocks find_fit examines, 0 = all */
+#endif
+#ifndef FIT_POLICY
+#define FIT_POLICY   MM_FIT_BEST /* How find_fit picks a block */
+#endif
+#ifndef FIT_GOOD
+#define FIT_GOOD     4         /* Fitting blocks a good-fit search compares */
+#endif
+#ifndef FIT_SLACK
+#define FIT_SLACK    (2 * DSIZE) /* Waste below which good fit stops early */
+#endif
+#ifndef PLACE_HIGH
+#define PLACE_HIGH   0         /* Place blocks this large high, 0 = none */
+#endif
+#ifndef QUICK_MAX
+#define QUICK_MAX    0         /* Defer frees up to this size, 0 = none */
+#endif
+#ifndef QUICK_BATCH
+#define QUICK_BATCH  256       /* Deferred frees between consolidations */
+#endif
+#ifndef MM_BACKEND
+#define MM_BACKEND   MM_BACKEND_SEGFIT /* Allocator behind the mm_ calls */
+#endif
+
+/* Free lists available to the run-time configuration */
+#define SEG_LIST_MAX (SEG_LIST_LEN > 64 ? SEG_LIST_LEN : 64)
+
+/* Quick lists, one per block size up to QUICK_CAP */
+#define QUICK_CAP    1024
+#define QUICK_BINS   (QUICK_CAP / DSIZE + 1)
+
+/* Maintenance thread, see mm_maint_start() */
+#define MAINT_RELEASE   (64 * 1024) /* Free blocks whose pages it releases */
+#define MAINT_AHEAD     4           /* Rounds of growth kept at the top */
+#define MAINT_AHEAD_MAX (1 << 20)   /* Most free bytes kept at the top */
+
+#ifdef MM_CLASS_GRAIN
+// A generated lookup table only fits the block alignment it was built for
+typedef char class_grain_is_dsize[(MM_CLASS_GRAIN == DSIZE) ? 1 : -1];
+#endif
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define MIN(x, y) ((x) > (y) ? (y) : (x))
@@ -54,6 +126,10 @@ team_t team = {
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc) ((size) | (alloc))
 
+/* The lifetime hint of a block is kept in bits 1-2 of both its tags */
+#define HINT(hint)  ((hint) << 1)
+#define GET_HINT(p) ((GET(p) >> 1) & 0x3)
+
 /* Read and write a word at address p */
 #define GET(p)      (*(unsigned int *)(p))
 #define PUT(p, val) (*(unsigned int *)(p) = (val))
@@ -75,52 +151,531 @@ team_t team = {
 #define PRED(bp) (*(unsigned char **)(bp))
 #define SUCC(bp) (*(unsigned char **)((bp) + WSIZE))
 
+/* Link of a block on a quick list */
+#define QNEXT(bp) (*(unsigned char **)(bp))
+
 typedef enum { ZERO_BLK = 0, FREE_BLK = 0, ALLOC_BLK = 1 } block_status_t;
 
+/*
+ * Block metadata. By default every block carries a header and a footer
+ * (boundary tags). Built with -DMM_SIDE_META, blocks carry no tags:
+ * bitmaps outside the heap, one bit per DSIZE granule, say where blocks
+ * start and which granules are allocated, so that freeing a block and
+ * checking its neighbours never touches the payload of an allocated
+ * block. A free block keeps its size next to its free-list links and in
+ * its last word, where coalescing finds the start of a free block before
+ * it once the bitmap says that block is free. The rest of the allocator
+ * only sees the block functions below.
+ */
+#ifndef MM_SIDE_META
+
+/* Bytes of a block that are not payload */
+#define TAG_SIZE DSIZE
+
+/* blk_size - size of block bp; 0 for the epilogue */
+static inline size_t blk_size(void *bp) {
+    return GET_SIZE(HDRP(bp));
+}
+
+/* free_size - size of free block bp */
+static inline size_t free_size(void *bp) {
+    return GET_SIZE(HDRP(bp));
+}
+
+static inline int blk_hint(void *bp) {
+    return GET_HINT(HDRP(bp));
+}
+
+static inline int blk_alloc(void *bp) {
+    return GET_ALLOC(HDRP(bp));
+}
+
+/* prev_alloc - whether the block before bp is allocated */
+static inline int prev_alloc(void *bp) {
+    return GET_ALLOC((unsigned char *)bp - DSIZE);
+}
+
+/* prev_blk - the block before bp, which must be free */
+static inline void *prev_blk(void *bp) {
+    return PREV_BLKP(bp);
+}
+
+/* set_alloc - make the size bytes at bp an allocated block */
+static inline void set_alloc(void *bp, size_t size, int hint) {
+    PUT(HDRP(bp), PACK(size, ALLOC_BLK | HINT(hint)));
+    PUT(FTRP(bp), PACK(size, ALLOC_BLK | HINT(hint)));
+}
+
+/*
+ * set_free - make the size bytes at bp a free block; they must be an
+ *     allocated block that release() was called on, free blocks and
+ *     blocks joined to bp, or new heap
+ */
+static inline void set_free(void *bp, size_t size, int hint) {
+    PUT(HDRP(bp), PACK(size, FREE_BLK | HINT(hint)));
+    PUT(FTRP(bp), PACK(size, FREE_BLK | HINT(hint)));
+}
+
+/* set_epilogue - end the heap at bp */
+static inline void set_epilogue(void *bp) {
+    PUT(HDRP(bp), PACK(0, ALLOC_BLK));
+}
+
+/* release - allocated block bp is about to be set free */
+static inline void release(void *bp, size_t size) {
+    (void)bp;
+    (void)size;
+}
+
+/* join - block bp becomes part of the block before it */
+static inline void join(void *bp) {
+    // Tags inside a block are never read
+    (void)bp;
+}
+
+#else /* MM_SIDE_META */
+
+#define TAG_SIZE 0
+
+/* Granules the heap can hold, and one for the epilogue */
+#define GRAINS   (MAX_HEAP / DSIZE + 1)
+#define MAP_BITS (8 * sizeof(unsigned long))
+#define MAP_LEN  ((GRAINS + MAP_BITS - 1) / MAP_BITS)
+
+/* Size of a free block, after its PRED and SUCC links and at its end */
+#define FSIZE(bp) (*(size_t *)((unsigned char *)(bp) + 2 * WSIZE))
+#define FTAIL(end) (*(size_t *)((unsigned char *)(end)-WSIZE))
+
+/*
+ * Bitmaps, each with a bit per granule: whether a block starts there,
+ * whether it belongs to an allocated block, and the two bits of the hint
+ * of the block that starts there. They are interleaved a word at a time
+ * so that all the bits of a granule share a cache line. The prologue
+ * and epilogue are one-granule allocated blocks. meta_end is the
+ * granule of the epilogue.
+ */
+enum { START_MAP, ALLOC_MAP, HINT_MAP, MAPS = HINT_MAP + 2 };
+static unsigned long meta[MAP_LEN][MAPS];
+static unsigned char *meta_base;
+static size_t meta_end;
+
+#define GRAIN(bp) ((size_t)((unsigned char *)(bp)-meta_base) / DSIZE)
+
+static inline int test_bit(int map, size_t i) {
+    return (meta[i / MAP_BITS][map] >> (i % MAP_BITS)) & 1;
+}
+
+static inline void put_bit(int map, size_t i, int val) {
+    unsigned long mask = 1UL << (i % MAP_BITS);
+
+    if (val) {
+        meta[i / MAP_BITS][map] |= mask;
+    } else {
+        meta[i / MAP_BITS][map] &= ~mask;
+    }
+}
+
+/* put_bits - set or clear bits [from, to) a word at a time */
+static void put_bits(int map, size_t from, size_t to, int val) {
+    while (from < to) {
+        size_t bit = from % MAP_BITS;
+        size_t n = MIN(MAP_BITS - bit, to - from);
+        unsigned long mask = (n == MAP_BITS) ? ~0UL : ((1UL << n) - 1) << bit;
+
+        if (val) {
+            meta[from / MAP_BITS][map] |= mask;
+        } else {
+            meta[from / MAP_BITS][map] &= ~mask;
+        }
+        from += n;
+    }
+}
+
+/* next_start - the first block start after granule i < meta_end */
+static size_t next_start(size_t i) {
+    size_t w = (i + 1) / MAP_BITS;
+    unsigned long bits = meta[w][START_MAP] & (~0UL << ((i + 1) % MAP_BITS));
+
+    while (bits == 0) {
+        bits = meta[++w][START_MAP];
+    }
+    return w * MAP_BITS + __builtin_ctzl(bits);
+}
+
+static inline size_t blk_size(void *bp) {
+    size_t g = GRAIN(bp);
+
+    return (g == meta_end) ? 0 : (next_start(g) - g) * DSIZE;
+}
+
+static inline size_t free_size(void *bp) {
+    return FSIZE(bp);
+}
+
+static inline int blk_hint(void *bp) {
+    size_t g = GRAIN(bp);
+
+    return test_bit(HINT_MAP, g) | (test_bit(HINT_MAP + 1, g) << 1);
+}
+
+static inline int blk_alloc(void *bp) {
+    return test_bit(ALLOC_MAP, GRAIN(bp));
+}
+
+static inline int prev_alloc(void *bp) {
+    return test_bit(ALLOC_MAP, GRAIN(bp) - 1);
+}
+
+static inline void *prev_blk(void *bp) {
+    return (unsigned char *)bp - FTAIL(bp);
+}
+
+static inline void set_start(size_t g, int hint) {
+    put_bit(START_MAP, g, 1);
+    put_bit(HINT_MAP, g, hint & 1);
+    put_bit(HINT_MAP + 1, g, hint >> 1);
+}
+
+static inline void set_alloc(void *bp, size_t size, int hint) {
+    size_t g = GRAIN(bp);
+
+    set_start(g, hint);
+    put_bits(ALLOC_MAP, g, g + size / DSIZE, 1);
+}
+
+// The bits of the granules after the first are already clear
+static inline void set_free(void *bp, size_t size, int hint) {
+    size_t g = GRAIN(bp);
+
+    set_start(g, hint);
+    put_bit(ALLOC_MAP, g, 0);
+    FSIZE(bp) = size;
+    FTAIL((unsigned char *)bp + size) = size;
+}
+
+static inline void set_epilogue(void *bp) {
+    size_t g = GRAIN(bp);
+
+    // Granules past the end must read as clear when the heap grows again
+    if (g < meta_end) {
+        put_bits(START_MAP, g + 1, meta_end + 1, 0);
+        put_bits(ALLOC_MAP, g + 1, meta_end + 1, 0);
+    }
+    meta_end = g;
+    set_start(meta_end, MM_HINT_NONE);
+    put_bit(ALLOC_MAP, meta_end, 1);
+}
+
+static inline void release(void *bp, size_t size) {
+    size_t g = GRAIN(bp);
+
+    put_bits(ALLOC_MAP, g, g + size / DSIZE, 0);
+}
+
+static inline void join(void *bp) {
+    put_bit(START_MAP, GRAIN(bp), 0);
+}
+
+#endif /* MM_SIDE_META */
+
 /* Declarations */
-static void place(void *bp, size_t asize);
-static void *find_fit(size_t asize);
-static void *extend_heap(size_t);
+static void *place(void *bp, size_t asize, int hint);
+static void *find_fit(size_t asize, int hint);
+static void *next_free(void *bp, void *head, void *start);
+static void *extend_heap(size_t, int hint);
 static void *coalesce(void *);
+static void free_block(void *bp, size_t size);
+static void consolidate(void);
+static void begin_heap(void);
+static size_t trim(void *gap, void *end);
+static void *seg_malloc(size_t size, int hint);
+static void seg_free(void *ptr);
+static void *maint_main(void *arg);
+static size_t maint_round(void **lo);
 static void *attach_free_list(void *bp, size_t asize);
 static void *detach_free_list(void *bp);
 static size_t asize_to_index(size_t asize);
 
-/* Heap list */
-static void *heap_listp = NULL;
-static void *free_listp[SEG_LIST_LEN] = {NULL};
+/*
+ * Handle table, itself a block in the heap. The payload of a handle
+ * block starts with its handle, so that mm_compact can tell it apart
+ * from other blocks, and the caller's part follows DSIZE bytes in.
+ * Free entries are chained through next from handle_free.
+ */
+#define HANDLE_INIT 64
+
+typedef struct {
+    void *bp;             // Block of the handle, NULL if free
+    int pins;             // mm_hpin calls not yet undone
+    mm_handle_t next;     // Next free entry
+} handle_t;
+
+/*
+ * Roots of the heap: the state besides the heap itself that a heap in
+ * use needs. They live in a static for memlib's anonymous heap, and on
+ * pages of their own in front of the prologue for a file-backed one
+ * (mem_persistent), where mm_attach finds them again after a restart or
+ * in a snapshot. magic is set once the heap is complete.
+ *
+ * The fields that every malloc and free may write come first, and the
+ * roots start on a page of their own. With the default limits those
+ * fields take about 4.6 KB on 64-bit: the first page holds the quick
+ * lists, all the free lists and the rovers of the first hints, and only
+ * the rovers of the last hints spill into the second. So in a process
+ * that maps a snapshot copy-on-write, requests that stay on the lists
+ * of the first hints copy one page of the roots, and others at most two.
+ */
+#define ROOTS_MAGIC 0x6d6d7274UL
+#define ROOTS_SIZE  (DSIZE * ((sizeof(roots_t) + DSIZE - 1) / DSIZE))
+
+typedef struct {
+    // Freed unhinted blocks of at most quick_max bytes whose freeing is
+    // deferred: their tags still say allocated, so nothing coalesces with
+    // them, and a request of the same size takes one back without a search.
+    int quick_count;
+    void *quick[QUICK_BINS];
+
+    // A set of free lists per lifetime hint
+    void *free_listp[MM_HINTS][SEG_LIST_MAX];
+
+    // Where the next next-fit search of each free list starts
+    void *rover[MM_HINTS][SEG_LIST_MAX];
+
+    unsigned long magic;
+    mm_config_t config;   // Configuration the heap was built with
+    void *heap_listp;     // Prologue block
+    void *user_root;      // See mm_set_root
+
+    handle_t *handle_tab;
+    int handle_cap;
+    mm_handle_t handle_free;
+} roots_t;
+
+static roots_t anon_roots;
+static roots_t *roots = &anon_roots;
+
+/* Searches by find_fit and the free blocks they examined, per policy */
+static size_t fit_searches[MM_FIT_POLICIES];
+static size_t fit_examined[MM_FIT_POLICIES];
+
+/* Run-time configuration, and log2 of the smallest block size */
+static mm_config_t config = {CHUNKSIZE, SEG_LIST_LEN, BIN_SUB, SPLIT_MIN,
+                             FIT_LIMIT, FIT_POLICY, FIT_GOOD, FIT_SLACK,
+                             PLACE_HIGH, QUICK_MAX, QUICK_BATCH, MM_BACKEND};
+static size_t min_log;
+
+/* The backend that the last mm_init chose */
+static int backend = MM_BACKEND_SEGFIT;
+
+/*
+ * Maintenance thread (mm_maint_start). While it runs, the mm_ calls that
+ * change the heap hold lock, and so does the thread for each round of
+ * work. Only the thread making the mm_ calls changes running, so they
+ * skip the lock when there is no thread.
+ */
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;  // Signalled to stop the thread
+    int running;
+    int stop;
+    int period_us;        // Time between rounds
+    size_t used;          // Heap below the top free block at the last round
+    size_t rate;          // Average growth of used per round
+    size_t extends;       // Heap extensions for a request
+    size_t pre_extends;   // Heap extensions by the thread
+    size_t released;      // Resident bytes of free blocks it released
+} maint = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER};
+
+static inline void maint_lock(void) {
+    if (maint.running) {
+        pthread_mutex_lock(&maint.lock);
+    }
+}
+
+static inline void maint_unlock(void) {
+    if (maint.running) {
+        pthread_mutex_unlock(&maint.lock);
+    }
+}
+
+/*
+ * mm_config - set the parameters used from the next mm_init on, or
+ *     restore the compiled-in defaults if c is NULL. Out-of-range
+ *     values are clamped.
+ */
+void mm_config(const mm_config_t *c) {
+    mm_config_t def = {CHUNKSIZE, SEG_LIST_LEN, BIN_SUB, SPLIT_MIN,
+                       FIT_LIMIT, FIT_POLICY, FIT_GOOD, FIT_SLACK,
+                       PLACE_HIGH, QUICK_MAX, QUICK_BATCH, MM_BACKEND};
+
+    config = (c != NULL) ? *c : def;
+    config.chunksize = MAX(ALIGN(config.chunksize), 2 * DSIZE);
+    config.bins = MIN(MAX(config.bins, 1), SEG_LIST_MAX);
+    config.bin_sub = MIN(MAX(config.bin_sub, 0), 4);
+    config.split_min = MAX(config.split_min, 2 * DSIZE);
+    config.fit_limit = MAX(config.fit_limit, 0);
+    if (config.fit_policy < 0 || config.fit_policy >= MM_FIT_POLICIES) {
+        config.fit_policy = FIT_POLICY;
+    }
+    config.fit_good = MAX(config.fit_good, 1);
+    config.place_high = ALIGN(config.place_high);
+    config.quick_max = MIN(config.quick_max, QUICK_CAP);
+    config.quick_batch = MAX(config.quick_batch, 1);
+    if (config.backend != MM_BACKEND_BUDDY) {
+        config.backend = MM_BACKEND_SEGFIT;
+    }
+#ifdef MM_CLASS_LIMITS
+    // The generated classes fix the binning
+    config.bins = SEG_LIST_LEN;
+    config.bin_sub = 0;
+#endif
+}
+
+/*
+ * mm_get_config - the parameters currently in effect
+ */
+void mm_get_config(mm_config_t *c) {
+    *c = config;
+}
 
 /*
  * mm_init - initialize the malloc package.
  */
 int mm_init(void) {
+    unsigned char *bp;
+
+    mm_maint_stop();
+    backend = config.backend;
+    roots = &anon_roots;
+    if (backend == MM_BACKEND_SEGFIT && mem_persistent()) {
+        // A file-backed heap keeps its roots in front of the prologue
+        size_t pages = (ROOTS_SIZE + mem_pagesize() - 1) / mem_pagesize();
+        if ((roots = mem_sbrk(pages * mem_pagesize())) == (void *)-1) {
+            return -1;
+        }
+    }
+    memset(roots, 0, sizeof(roots_t));
+    roots->config = config;
+    roots->handle_free = MM_HNULL;
+    begin_heap();
+    if (backend == MM_BACKEND_BUDDY) {
+        return buddy_init(config.chunksize);
+    }
+
+#ifndef MM_SIDE_META
     // Create the initial emtpy heap
-    if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1) {
+    if ((bp = mem_sbrk(4 * WSIZE)) == (void *)-1) {
         return -1;
     }
 
-    PUT(heap_listp, 0);                                     // Alignment padding
-    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, ALLOC_BLK));  // Prologue header
-    PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, ALLOC_BLK));  // Prologue footer
-    PUT(heap_listp + (3 * WSIZE), PACK(0, ALLOC_BLK));      // Epilogue header
+    PUT(bp, 0);                                     // Alignment padding
+    PUT(bp + (1 * WSIZE), PACK(DSIZE, ALLOC_BLK));  // Prologue header
+    PUT(bp + (2 * WSIZE), PACK(DSIZE, ALLOC_BLK));  // Prologue footer
+    PUT(bp + (3 * WSIZE), PACK(0, ALLOC_BLK));      // Epilogue header
 
-    heap_listp = heap_listp + (2 * WSIZE);
-    for (size_t i = 0; i < SEG_LIST_LEN; i++) {
-        free_listp[i] = NULL;
+    roots->heap_listp = bp + (2 * WSIZE);
+#else
+    // The epilogue clears the bits that the last heap used
+    if ((bp = mem_sbrk(DSIZE)) == (void *)-1) {
+        return -1;
     }
+    meta_base = bp;
+    set_alloc(bp, DSIZE, MM_HINT_NONE);
+    set_epilogue(bp + DSIZE);
+    roots->heap_listp = bp;
+#endif
 
-    // Extend the empty heap with a free block of CHUNKSIZE bytes
-    if (extend_heap(CHUNKSIZE / WSIZE) == NULL) {
+    // Extend the empty heap with a free block of chunksize bytes
+    if (extend_heap(config.chunksize / WSIZE, MM_HINT_NONE) == NULL) {
         return -1;
     }
+    roots->magic = ROOTS_MAGIC;
     return 0;
 }
 
+/*
+ * mm_attach - take up the heap that a file-backed memlib (see
+ *     mem_init_file) kept from an earlier run, in place of mm_init.
+ *     The heap keeps the configuration it was built with. Returns -1
+ *     if there is no complete heap to attach to. Attaching is not
+ *     supported with MM_SIDE_META, whose bitmaps are not part of the
+ *     heap, so it always returns -1 there.
+ */
+int mm_attach(void) {
+#ifdef MM_SIDE_META
+    return -1;
+#else
+    roots_t *r = mem_heap_lo();
+
+    if (!mem_persistent() || mem_heapsize() < ROOTS_SIZE ||
+        r->magic != ROOTS_MAGIC) {
+        return -1;
+    }
+    mm_maint_stop();
+    roots = r;
+    config = r->config;
+    backend = MM_BACKEND_SEGFIT;
+    begin_heap();
+    return 0;
+#endif
+}
+
+/*
+ * begin_heap - reset the state that is not kept with the heap
+ */
+static void begin_heap(void) {
+    memset(fit_searches, 0, sizeof(fit_searches));
+    memset(fit_examined, 0, sizeof(fit_examined));
+    maint.extends = maint.pre_extends = maint.released = 0;
+    maint.used = maint.rate = 0;
+    for (min_log = 0; ((2 * DSIZE) >> (min_log + 1)) != 0; min_log++) {
+    }
+}
+
+/*
+ * mm_set_root - keep p, the root of the caller's data in the heap,
+ *     with the heap, to be found by mm_get_root after mm_attach
+ */
+void mm_set_root(void *p) {
+    roots->user_root = p;
+}
+
+void *mm_get_root(void) {
+    return roots->user_root;
+}
+
 /*
  * mm_malloc - Allocate a block by incrementing the brk pointer.
  *     Always allocate a block whose size is a multiple of the alignment.
  */
 void *mm_malloc(size_t size) {
+    return mm_malloc_hint(size, MM_HINT_NONE);
+}
+
+/*
+ * mm_malloc_hint - mm_malloc for a block with an expected lifetime.
+ *     Each hint has a set of free lists of its own, and the heap grows
+ *     for the hint that ran out of space, so blocks of one lifetime
+ *     fill chunks of their own instead of pinning free space between
+ *     blocks of another. Unknown hints are taken as MM_HINT_NONE.
+ */
+void *mm_malloc_hint(size_t size, int hint) {
+    void *bp;
+
+    if (backend == MM_BACKEND_BUDDY) {
+        return buddy_malloc(size);
+    }
+    maint_lock();
+    bp = seg_malloc(size, hint);
+    maint_unlock();
+    return bp;
+}
+
+/*
+ * seg_malloc - mm_malloc_hint for the segregated-fit backend
+ */
+static void *seg_malloc(size_t size, int hint) {
     size_t asize;
     size_t extend_size;
     unsigned char *bp;
@@ -129,60 +684,128 @@ void *mm_malloc(size_t size) {
         return NULL;
     }
 
-    if (size <= DSIZE) {
-        asize = 2 * DSIZE;
-    } else {
-        asize = DSIZE * ((size + DSIZE + DSIZE - 1) / DSIZE);
+    asize = MAX(2 * DSIZE, DSIZE * ((size + TAG_SIZE + DSIZE - 1) / DSIZE));
+
+    if (hint < 0 || hint >= MM_HINTS) {
+        hint = MM_HINT_NONE;
     }
 
-    if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize);
+    // Reuse a deferred free of the same size. Only unhinted blocks are
+    // deferred, so a hinted request always lands in its hint's region.
+    if (hint == MM_HINT_NONE && asize <= config.quick_max &&
+        roots->quick[asize / DSIZE] != NULL) {
+        bp = roots->quick[asize / DSIZE];
+        roots->quick[asize / DSIZE] = QNEXT(bp);
+        roots->quick_count--;
+        set_alloc(bp, asize, hint);
         return bp;
     }
 
-    extend_size = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extend_size / WSIZE)) == NULL) {
+    if ((bp = find_fit(asize, hint)) != NULL) {
+        return place(bp, asize, hint);
+    }
+    // Borrow from the free lists of the other hints before growing
+    for (int h = 0; h < MM_HINTS; h++) {
+        if (h != hint && (bp = find_fit(asize, h)) != NULL) {
+            return place(bp, asize, hint);
+        }
+    }
+
+    // Consolidate the deferred frees and search again before growing
+    if (roots->quick_count > 0) {
+        consolidate();
+        return seg_malloc(size, hint);
+    }
+
+    maint.extends++;
+    extend_size = MAX(asize, config.chunksize);
+    if ((bp = extend_heap(extend_size / WSIZE, hint)) == NULL) {
         return NULL;
     }
-    place(bp, asize);
-    return bp;
+    return place(bp, asize, hint);
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_free - Free a block, or defer that by putting a small unhinted
+ *     block on a quick list. Every quick_batch deferred frees are
+ *     consolidated.
  */
 void mm_free(void *ptr) {
-    size_t size = GET_SIZE(HDRP(ptr));
+    if (backend == MM_BACKEND_BUDDY) {
+        buddy_free(ptr);
+        return;
+    }
+    maint_lock();
+    seg_free(ptr);
+    maint_unlock();
+}
+
+/*
+ * seg_free - mm_free for the segregated-fit backend
+ */
+static void seg_free(void *ptr) {
+    size_t size = blk_size(ptr);
 
-    PUT(HDRP(ptr), PACK(size, FREE_BLK));
-    PUT(FTRP(ptr), PACK(size, FREE_BLK));
-    coalesce(ptr);
+    if (size <= config.quick_max && blk_hint(ptr) == MM_HINT_NONE) {
+        QNEXT(ptr) = roots->quick[size / DSIZE];
+        roots->quick[size / DSIZE] = ptr;
+        if (++roots->quick_count >= config.quick_batch) {
+            consolidate();
+        }
+        return;
+    }
+    free_block(ptr, size);
 }
 
+/*
+ * free_block - mark block bp of size bytes free and coalesce it
+ */
+static void free_block(void *bp, size_t size) {
+    release(bp, size);
+    set_free(bp, size, blk_hint(bp));
+    coalesce(bp);
+}
+
+/*
+ * consolidate - free the blocks on the quick lists for real
+ */
+static void consolidate(void) {
+    void *bp;
+
+    for (size_t i = 0; i < QUICK_BINS; i++) {
+        while ((bp = roots->quick[i]) != NULL) {
+            roots->quick[i] = QNEXT(bp);
+            free_block(bp, i * DSIZE);
+        }
+    }
+    roots->quick_count = 0;
+}
+
+/*
+ * coalesce - merge free block ptr with its free neighbours and put the
+ *     result on a free list. The merged block keeps the hint of ptr.
+ */
 static void *coalesce(void *ptr) {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(ptr)));
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(ptr)));
-    size_t size = GET_SIZE(HDRP(ptr));
-
-    // Update free list and header, footer
-    if (prev_alloc && !next_alloc) {
-        detach_free_list(NEXT_BLKP(ptr));
-        size += GET_SIZE(HDRP(NEXT_BLKP(ptr)));
-        PUT(HDRP(ptr), PACK(size, FREE_BLK));
-        PUT(FTRP(ptr), PACK(size, FREE_BLK));
-    } else if (!prev_alloc && next_alloc) {
-        detach_free_list(PREV_BLKP(ptr));
-        size += GET_SIZE(HDRP(PREV_BLKP(ptr)));
-        PUT(FTRP(ptr), PACK(size, FREE_BLK));
-        PUT(HDRP(PREV_BLKP(ptr)), PACK(size, FREE_BLK));
-        ptr = PREV_BLKP(ptr);
-    } else if (!prev_alloc && !next_alloc) {
-        detach_free_list(PREV_BLKP(ptr));
-        detach_free_list(NEXT_BLKP(ptr));
-        size += GET_SIZE(HDRP(PREV_BLKP(ptr))) + GET_SIZE(FTRP(NEXT_BLKP(ptr)));
-        PUT(HDRP(PREV_BLKP(ptr)), PACK(size, FREE_BLK));
-        PUT(FTRP(NEXT_BLKP(ptr)), PACK(size, FREE_BLK));
-        ptr = PREV_BLKP(ptr);
+    size_t size = free_size(ptr);
+    int hint = blk_hint(ptr);
+    unsigned char *next = (unsigned char *)ptr + size;
+    void *prev;
+
+    if (!blk_alloc(next)) {
+        detach_free_list(next);
+        size += free_size(next);
+        join(next);
+    }
+    if (!prev_alloc(ptr)) {
+        prev = prev_blk(ptr);
+        detach_free_list(prev);
+        size += free_size(prev);
+        join(ptr);
+        ptr = prev;
+    }
+    // Retag only if a neighbour was merged in
+    if (size != free_size(ptr) || hint != blk_hint(ptr)) {
+        set_free(ptr, size, hint);
     }
 
     attach_free_list(ptr, size);
@@ -190,27 +813,35 @@ static void *coalesce(void *ptr) {
 }
 
 /*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
+ * mm_realloc - Implemented simply in terms of seg_malloc and seg_free,
+ *     all under the maintenance lock, so that the thread does not move
+ *     or release the old block while it is read
  */
 void *mm_realloc(void *ptr, size_t size) {
     void *oldptr = ptr;
     void *newptr;
     size_t copySize;
 
-    newptr = mm_malloc(size);
-    if (newptr == NULL) return NULL;
-    // copySize = *(size_t *)((char *)oldptr - SIZE_T_SIZE);
-    // if (size < copySize)
-    copySize = size;
-    memcpy(newptr, oldptr, copySize);
-    mm_free(oldptr);
+    if (backend == MM_BACKEND_BUDDY) {
+        return buddy_realloc(ptr, size);
+    }
+
+    maint_lock();
+    newptr = seg_malloc(size, blk_hint(oldptr));
+    if (newptr != NULL) {
+        copySize = MIN(size, blk_size(oldptr) - TAG_SIZE);
+        memcpy(newptr, oldptr, copySize);
+        seg_free(oldptr);
+    }
+    maint_unlock();
     return newptr;
 }
 
 /*
- * extend_heap - Extend the heap by allocating a new free block.
+ * extend_heap - Extend the heap by allocating a new free block for
+ *     blocks with the given hint.
  */
-static void *extend_heap(size_t words) {
+static void *extend_heap(size_t words, int hint) {
     char *bp;
     size_t size;
 
@@ -220,56 +851,126 @@ static void *extend_heap(size_t words) {
         return NULL;
     }
 
-    // Initialize free block header/footer and the epilogue header
-    PUT(HDRP(bp), PACK(size, FREE_BLK));           // Free block header
-    PUT(FTRP(bp), PACK(size, FREE_BLK));           // Free block footer
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC_BLK));  // New epilogue header
+    // The new free block takes the place of the old epilogue
+    set_free(bp, size, hint);
+    set_epilogue(bp + size);
 
     // Coalesce if the previous block was free
     return coalesce(bp);
 }
 
-static void *find_fit(size_t asize) {
+static void *find_fit(size_t asize, int hint) {
+    void **lists = roots->free_listp[hint];
+    void **rovers = roots->rover[hint];
     size_t start_index = asize_to_index(asize);
-    for (size_t i = start_index; i < SEG_LIST_LEN; i++) {
-        if (free_listp[i] == NULL) {
-            continue;
+    int budget = config.fit_limit;
+    int policy = config.fit_policy;
+    int candidates = 0;
+    void *best = NULL;
+    size_t size, best_size = 0;
+
+    fit_searches[policy]++;
+    for (size_t i = start_index; i < (size_t)config.bins; i++) {
+        void *start = lists[i];
+        if (policy == MM_FIT_NEXT && rovers[i] != NULL) {
+            start = rovers[i];
         }
 
-        for (void *bp = free_listp[i]; bp != NULL; bp = SUCC(bp)) {
-            if (GET_SIZE(HDRP(bp)) >= asize) {
-                return bp;
+        for (void *bp = start; bp != NULL;
+             bp = next_free(bp, lists[i], start)) {
+            fit_examined[policy]++;
+            size = free_size(bp);
+            if (size >= asize) {
+                if (policy == MM_FIT_NEXT) {
+                    rovers[i] = bp;
+                }
+                if (policy != MM_FIT_GOOD) {
+                    return bp;
+                }
+                if (best == NULL || size < best_size) {
+                    best = bp;
+                    best_size = size;
+                }
+                if (size - asize < config.fit_slack ||
+                    ++candidates >= config.fit_good) {
+                    return best;
+                }
+            }
+            // Give up and let the caller extend the heap
+            if (budget > 0 && --budget == 0) {
+                return best;
             }
         }
+
+        // The blocks of any later list are larger than the best so far
+        if (best != NULL) {
+            return best;
+        }
     }
 
     return NULL;
 }
 
-static void place(void *bp, size_t asize) {
-    size_t csize = GET_SIZE(HDRP(bp));
+/*
+ * next_free - the block after bp in the free list that starts at head,
+ *     for a search that began at start: a next-fit search wraps around
+ *     to the front of the list and ends where it began.
+ */
+static void *next_free(void *bp, void *head, void *start) {
+    void *next = SUCC(bp);
+
+    if (next == NULL) {
+        next = head;
+    }
+    return (next == start) ? NULL : next;
+}
+
+/*
+ * place - allocate asize bytes of free block bp and return the
+ *     allocated block. A large enough remainder is split off as a free
+ *     block above the allocation, or below it for requests of at least
+ *     place_high bytes, so that large blocks collect at the high end of
+ *     free space and small ones at the low end. The allocated block
+ *     takes hint, the remainder keeps the hint of the free block. The
+ *     neighbours of a free block are never free, so neither are those
+ *     of the remainder, which goes on a free list without coalescing.
+ */
+static void *place(void *bp, size_t asize, int hint) {
+    size_t csize = free_size(bp);
+    int rest_hint = blk_hint(bp);
+    void *rest;
+
     detach_free_list(bp);
-    if ((csize - asize) >= (2 * DSIZE)) {
-        PUT(HDRP(bp), PACK(asize, ALLOC_BLK));
-        PUT(FTRP(bp), PACK(asize, ALLOC_BLK));
-        bp = NEXT_BLKP(bp);
-        PUT(HDRP(bp), PACK(csize - asize, FREE_BLK));
-        PUT(FTRP(bp), PACK(csize - asize, FREE_BLK));
-        coalesce(bp);
+    if ((csize - asize) < config.split_min) {
+        set_alloc(bp, csize, hint);
+        return bp;
+    }
+
+    if (config.place_high > 0 && asize >= config.place_high) {
+        rest = bp;
+        set_free(rest, csize - asize, rest_hint);
+        bp = (unsigned char *)rest + (csize - asize);
+        set_alloc(bp, asize, hint);
     } else {
-        PUT(HDRP(bp), PACK(csize, ALLOC_BLK));
-        PUT(FTRP(bp), PACK(csize, ALLOC_BLK));
+        set_alloc(bp, asize, hint);
+        rest = (unsigned char *)bp + asize;
+        set_free(rest, csize - asize, rest_hint);
     }
+    attach_free_list(rest, csize - asize);
+    return bp;
 }
 
 static void *attach_free_list(void *bp, size_t asize) {
+    void **lists = roots->free_listp[blk_hint(bp)];
     void *current;
     void *tmp = NULL;
 
     size_t index = asize_to_index(asize);
 
-    current = free_listp[index];
-    while ((current != NULL) && (asize > GET_SIZE(HDRP(current)))) {
+    current = lists[index];
+    // Only best fit needs the list sorted, the others insert at the front
+    while (config.fit_policy == MM_FIT_BEST && (current != NULL) &&
+           (asize > free_size(current))) {
         tmp = current;
         current = SUCC(current);
     }
@@ -284,7 +985,7 @@ static void *attach_free_list(void *bp, size_t asize) {
             SUCC(bp) = current;
             PRED(bp) = NULL;
             PRED(current) = bp;
-            free_listp[index] = bp;
+            lists[index] = bp;
         }
     } else {
         if (tmp != NULL) {
@@ -294,7 +995,7 @@ static void *attach_free_list(void *bp, size_t asize) {
         } else {
             SUCC(bp) = NULL;
             PRED(bp) = NULL;
-            free_listp[index] = bp;
+            lists[index] = bp;
         }
     }
 
@@ -302,11 +1003,16 @@ static void *attach_free_list(void *bp, size_t asize) {
 }
 
 static void *detach_free_list(void *bp) {
-    size_t asize = GET_SIZE(HDRP(bp));
+    void **lists = roots->free_listp[blk_hint(bp)];
+    void **rovers = roots->rover[blk_hint(bp)];
+    size_t asize = free_size(bp);
     size_t index = asize_to_index(asize);
-    if (bp == free_listp[index]) {
-        free_listp[index] = SUCC(bp);
-        if (free_listp[index] != NULL) {
+    if (bp == rovers[index]) {
+        rovers[index] = SUCC(bp);
+    }
+    if (bp == lists[index]) {
+        lists[index] = SUCC(bp);
+        if (lists[index] != NULL) {
             PRED(SUCC(bp)) = NULL;
         }
     } else if (SUCC(bp) == NULL) {
@@ -320,6 +1026,26 @@ static void *detach_free_list(void *bp) {
 }
 
 static size_t asize_to_index(size_t asize) {
+#ifdef MM_CLASS_LIMITS
+#ifdef MM_CLASS_LUT
+    static const unsigned char lut[] = MM_CLASS_LUT;
+    if (asize <= MM_CLASS_LUT_MAX) {
+        return lut[asize / DSIZE];
+    }
+#endif
+    // Smallest class whose limit is at least asize; the last is unbounded
+    static const size_t limits[SEG_LIST_LEN] = MM_CLASS_LIMITS;
+    size_t lo = 0, hi = SEG_LIST_LEN - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (limits[mid] < asize) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+#else
     size_t power = 1;
     size_t index = 0;
     if (asize == 0) {
@@ -330,8 +1056,382 @@ static size_t asize_to_index(size_t asize) {
         index += 1;
     }
 
-    if (index >= SEG_LIST_LEN) {
-        index = SEG_LIST_LEN - 1;
+    // Split each power of two into 2^bin_sub lists above the smallest
+    // block size; the lists below it stay empty, as with bin_sub 0
+    if (config.bin_sub > 0 && index > min_log) {
+        size_t sub = (asize >> (index - 1 - config.bin_sub)) &
+                     ((1 << config.bin_sub) - 1);
+        index = min_log + 1 + ((index - 1 - min_log) << config.bin_sub) + sub;
+    }
+    if (index >= (size_t)config.bins) {
+        index = config.bins - 1;
     }
     return index;
-}
\ No newline at end of file
+#endif
+}
+
+/*
+ * mm_heapstats - Walk the heap from the prologue to the epilogue and
+ *     account every block as allocated or free.
+ */
+void mm_heapstats(mm_heapstats_t *stats) {
+    unsigned char *first = roots->heap_listp;
+    size_t size;
+
+    if (backend == MM_BACKEND_BUDDY) {
+        buddy_heapstats(stats);
+        return;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    maint_lock();
+    stats->heap_bytes = mem_heapsize();
+    if (first == NULL) {
+        maint_unlock();
+        return;
+    }
+
+    for (unsigned char *bp = first + blk_size(first); (size = blk_size(bp)) > 0;
+         bp += size) {
+        if (blk_alloc(bp)) {
+            stats->alloc_bytes += size;
+            stats->alloc_blocks++;
+        } else {
+            stats->free_bytes += size;
+            stats->free_blocks++;
+            stats->largest_free = MAX(stats->largest_free, size);
+        }
+    }
+    // Deferred frees are free space, though their tags say allocated
+    for (size_t i = 0; i < QUICK_BINS; i++) {
+        for (void *bp = roots->quick[i]; bp != NULL; bp = QNEXT(bp)) {
+            stats->alloc_bytes -= blk_size(bp);
+            stats->alloc_blocks--;
+            stats->free_bytes += blk_size(bp);
+            stats->free_blocks++;
+        }
+    }
+    memcpy(stats->fit_searches, fit_searches, sizeof(fit_searches));
+    memcpy(stats->fit_examined, fit_examined, sizeof(fit_examined));
+    stats->extends = maint.extends;
+    stats->maint_extends = maint.pre_extends;
+    stats->maint_released = maint.released;
+    maint_unlock();
+}
+
+/*
+ * mm_halloc - allocate a relocatable block of size bytes and return
+ *     its handle, or MM_HNULL
+ */
+mm_handle_t mm_halloc(size_t size) {
+    handle_t *tab;
+    mm_handle_t h;
+    int cap;
+
+    if (roots->handle_free == MM_HNULL) {
+        // Double the table; the new entries go on the free chain
+        cap = roots->handle_cap ? 2 * roots->handle_cap : HANDLE_INIT;
+        if ((tab = mm_malloc(cap * sizeof(handle_t))) == NULL) {
+            return MM_HNULL;
+        }
+        if (roots->handle_tab != NULL) {
+            memcpy(tab, roots->handle_tab,
+                   roots->handle_cap * sizeof(handle_t));
+            mm_free(roots->handle_tab);
+        }
+        for (h = roots->handle_cap; h < cap; h++) {
+            tab[h].bp = NULL;
+            tab[h].pins = 0;
+            tab[h].next = (h + 1 < cap) ? h + 1 : MM_HNULL;
+        }
+        roots->handle_free = roots->handle_cap;
+        roots->handle_tab = tab;
+        roots->handle_cap = cap;
+    }
+
+    h = roots->handle_free;
+    if ((roots->handle_tab[h].bp = mm_malloc(size + DSIZE)) == NULL) {
+        return MM_HNULL;
+    }
+    roots->handle_free = roots->handle_tab[h].next;
+    roots->handle_tab[h].pins = 0;
+    *(mm_handle_t *)roots->handle_tab[h].bp = h;
+    return h;
+}
+
+/*
+ * mm_hfree - free the block of handle h, which must not be pinned
+ */
+void mm_hfree(mm_handle_t h) {
+    mm_free(roots->handle_tab[h].bp);
+    roots->handle_tab[h].bp = NULL;
+    roots->handle_tab[h].next = roots->handle_free;
+    roots->handle_free = h;
+}
+
+/*
+ * mm_hpin - the payload of handle h, which stays put until mm_hunpin
+ */
+void *mm_hpin(mm_handle_t h) {
+    roots->handle_tab[h].pins++;
+    return (unsigned char *)roots->handle_tab[h].bp + DSIZE;
+}
+
+void mm_hunpin(mm_handle_t h) {
+    roots->handle_tab[h].pins--;
+}
+
+/*
+ * handle_of - the handle of block bp if it is the block of an unpinned
+ *     handle, else MM_HNULL
+ */
+static mm_handle_t handle_of(void *bp) {
+    mm_handle_t h = *(mm_handle_t *)bp;
+
+    if (h >= 0 && h < roots->handle_cap && roots->handle_tab[h].bp == bp &&
+        roots->handle_tab[h].pins == 0) {
+        return h;
+    }
+    return MM_HNULL;
+}
+
+/*
+ * move_block - move allocated block bp of size bytes down to gap,
+ *     which the free space below it starts at
+ */
+static void move_block(void *bp, size_t size, void *gap) {
+    int hint = blk_hint(bp);
+
+    release(bp, size);
+    join(bp);
+    memmove(gap, bp, size - TAG_SIZE);
+    set_alloc(gap, size, hint);
+}
+
+/*
+ * mm_compact - walk the heap and slide the blocks of unpinned handles,
+ *     and the handle table, down to the start of the free space below
+ *     them. Free space ends up in one free block below each block that
+ *     cannot move, and at the top of the heap, which is given back to
+ *     memlib.
+ */
+size_t mm_compact(void) {
+    unsigned char *bp, *gap = NULL;
+    size_t size;
+    mm_handle_t h;
+
+    if (backend == MM_BACKEND_BUDDY || roots->heap_listp == NULL) {
+        return 0;
+    }
+    maint_lock();
+    if (roots->quick_count > 0) {
+        consolidate();
+    }
+
+    bp = roots->heap_listp;
+    for (bp += blk_size(bp); (size = blk_size(bp)) > 0; bp += size) {
+        if (!blk_alloc(bp)) {
+            // Free space joins the gap
+            detach_free_list(bp);
+            if (gap == NULL) {
+                gap = bp;
+            } else {
+                join(bp);
+            }
+        } else if (gap != NULL && bp == (unsigned char *)roots->handle_tab) {
+            move_block(bp, size, gap);
+            roots->handle_tab = (handle_t *)gap;
+            gap += size;
+        } else if (gap != NULL && (h = handle_of(bp)) != MM_HNULL) {
+            move_block(bp, size, gap);
+            roots->handle_tab[h].bp = gap;
+            gap += size;
+        } else if (gap != NULL) {
+            // The block stays, so the gap below it becomes a free block
+            set_free(gap, bp - gap, MM_HINT_NONE);
+            attach_free_list(gap, bp - gap);
+            gap = NULL;
+        }
+    }
+
+    // bp is the epilogue, and the gap the free space at the top
+    size = (gap != NULL) ? trim(gap, bp) : 0;
+    maint_unlock();
+    return size;
+}
+
+/*
+ * trim - give the free space from gap up to the epilogue at end, which
+ *     is on no free list, back to memlib and return its size
+ */
+static size_t trim(void *gap, void *end) {
+    size_t size = (unsigned char *)end - (unsigned char *)gap;
+
+    set_epilogue(gap);
+    mem_release(gap, size);
+    mem_sbrk(-(int)size);
+    return size;
+}
+
+/*
+ * mm_snapshot - copy a file-backed heap into a template that other
+ *     processes map copy-on-write (mem_init_snapshot) and take up with
+ *     mm_attach. The quick lists are emptied and the free block at the
+ *     top of the heap is given back first, so that the first
+ *     allocations of those processes grow the heap into pages of their
+ *     own instead of splitting a block whose tags sit on shared pages.
+ *     Returns the descriptor of the template, or -1.
+ */
+int mm_snapshot(void) {
+    unsigned char *end;
+    void *top;
+    int fd;
+
+    if (backend == MM_BACKEND_BUDDY || roots == &anon_roots) {
+        return -1;
+    }
+    maint_lock();
+    end = (unsigned char *)mem_heap_hi() + 1;
+    if (roots->quick_count > 0) {
+        consolidate();
+    }
+    if (!prev_alloc(end)) {
+        top = prev_blk(end);
+        detach_free_list(top);
+        trim(top, end);
+    }
+    fd = mem_snapshot();
+    maint_unlock();
+    return fd;
+}
+
+/*
+ * mm_maint_start - start the maintenance thread, which does a round of
+ *     work every period_us microseconds. Returns -1 if it already runs,
+ *     the heap is not a segregated-fit heap, or the thread could not be
+ *     created.
+ */
+int mm_maint_start(int period_us) {
+    if (maint.running || backend == MM_BACKEND_BUDDY ||
+        roots->heap_listp == NULL) {
+        return -1;
+    }
+    maint.period_us = MAX(period_us, 1);
+    maint.stop = 0;
+    maint.used = mem_heapsize();
+    maint.rate = 0;
+    if (pthread_create(&maint.thread, NULL, maint_main, NULL) != 0) {
+        return -1;
+    }
+    maint.running = 1;
+    return 0;
+}
+
+/*
+ * mm_maint_stop - stop the maintenance thread and wait for it to exit
+ */
+void mm_maint_stop(void) {
+    if (!maint.running) {
+        return;
+    }
+    pthread_mutex_lock(&maint.lock);
+    maint.stop = 1;
+    pthread_cond_signal(&maint.wake);
+    pthread_mutex_unlock(&maint.lock);
+    pthread_join(maint.thread, NULL);
+    maint.running = 0;
+}
+
+/*
+ * maint_main - the maintenance thread. It holds the lock except while
+ *     it waits for the next round and while it faults in the heap that
+ *     a round added, which the mm_ calls may already be using.
+ */
+static void *maint_main(void *arg) {
+    struct timespec t;
+    void *lo;
+    size_t len;
+
+    (void)arg;
+    pthread_mutex_lock(&maint.lock);
+    while (!maint.stop) {
+        clock_gettime(CLOCK_REALTIME, &t);
+        t.tv_sec += maint.period_us / 1000000;
+        t.tv_nsec += (long)(maint.period_us % 1000000) * 1000;
+        if (t.tv_nsec >= 1000000000) {
+            t.tv_sec++;
+            t.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&maint.wake, &maint.lock, &t);
+        if (maint.stop) {
+            break;
+        }
+        if ((len = maint_round(&lo)) > 0) {
+            pthread_mutex_unlock(&maint.lock);
+            mem_prefault(lo, len);
+            pthread_mutex_lock(&maint.lock);
+        }
+    }
+    pthread_mutex_unlock(&maint.lock);
+    return NULL;
+}
+
+/*
+ * maint_round - one round of maintenance: free the deferred frees,
+ *     release the pages inside the large free blocks below the top one,
+ *     and extend the heap so that the top free block holds what the
+ *     heap grew by over the last MAINT_AHEAD rounds on average. Returns
+ *     the size of the extension and sets *lo to its start.
+ */
+static size_t maint_round(void **lo) {
+    unsigned char *end, *top;
+    size_t top_size, used, grown, want, words;
+    void *bp;
+
+    if (roots->quick_count > 0) {
+        consolidate();
+    }
+
+    end = (unsigned char *)mem_heap_hi() + 1;
+    top = prev_alloc(end) ? NULL : prev_blk(end);
+    for (int h = 0; h < MM_HINTS; h++) {
+        for (size_t i = asize_to_index(MAINT_RELEASE);
+             i < (size_t)config.bins; i++) {
+            for (bp = roots->free_listp[h][i]; bp != NULL; bp = SUCC(bp)) {
+                size_t size = free_size(bp);
+                // Spare the links and sizes at both ends of the block, and
+                // skip blocks with nothing resident, such as the ones
+                // released by an earlier round and not used since. Count
+                // only what the release took out of memory: the pages of a
+                // snapshot stay resident in its file.
+                unsigned char *p = (unsigned char *)bp + 2 * DSIZE;
+                size_t len = size - 3 * DSIZE, resident;
+                if (bp != top && size >= MAINT_RELEASE &&
+                    (resident = mem_resident_in(p, len)) > 0 &&
+                    mem_release(p, len) > 0) {
+                    maint.released += resident - MIN(resident,
+                                                     mem_resident_in(p, len));
+                }
+            }
+        }
+    }
+
+    // Keep ahead of the recent growth of the heap in use
+    top_size = (top != NULL) ? free_size(top) : 0;
+    used = mem_heapsize() - top_size;
+    grown = (used > maint.used) ? used - maint.used : 0;
+    maint.rate = (3 * maint.rate + grown) / 4;
+    maint.used = used;
+    want = MIN(MAX(config.chunksize, MAINT_AHEAD * maint.rate),
+               MAINT_AHEAD_MAX);
+    if (top_size >= want) {
+        return 0;
+    }
+    words = (want - top_size + WSIZE - 1) / WSIZE;
+    *lo = end;
+    if (extend_heap(words, MM_HINT_NONE) == NULL) {
+        return 0;
+    }
+    maint.pre_extends++;
+    return (unsigned char *)mem_heap_hi() + 1 - end;
+}
@@ -1,10 +1,178 @@
+#ifndef __MM_H_
+#define __MM_H_
+
 #include <stdio.h>
 
+/*
+ * When mm.c is compiled with -DMM_PREFIX=p (see VARIANTS in the
+ * Makefile), its public names become p_init, p_malloc, ... so that
+ * several differently configured copies can be linked into one driver.
+ */
+#ifdef MM_PREFIX
+#define MM_PASTE2(p, s) p##s
+#define MM_PASTE(p, s)  MM_PASTE2(p, s)
+#define mm_init         MM_PASTE(MM_PREFIX, _init)
+#define mm_malloc       MM_PASTE(MM_PREFIX, _malloc)
+#define mm_malloc_hint  MM_PASTE(MM_PREFIX, _malloc_hint)
+#define mm_free         MM_PASTE(MM_PREFIX, _free)
+#define mm_realloc      MM_PASTE(MM_PREFIX, _realloc)
+#define mm_heapstats    MM_PASTE(MM_PREFIX, _heapstats)
+#define mm_config       MM_PASTE(MM_PREFIX, _config)
+#define mm_get_config   MM_PASTE(MM_PREFIX, _get_config)
+#define mm_halloc       MM_PASTE(MM_PREFIX, _halloc)
+#define mm_hfree        MM_PASTE(MM_PREFIX, _hfree)
+#define mm_hpin         MM_PASTE(MM_PREFIX, _hpin)
+#define mm_hunpin       MM_PASTE(MM_PREFIX, _hunpin)
+#define mm_compact      MM_PASTE(MM_PREFIX, _compact)
+#define mm_attach       MM_PASTE(MM_PREFIX, _attach)
+#define mm_set_root     MM_PASTE(MM_PREFIX, _set_root)
+#define mm_get_root     MM_PASTE(MM_PREFIX, _get_root)
+#define mm_snapshot     MM_PASTE(MM_PREFIX, _snapshot)
+#define mm_maint_start  MM_PASTE(MM_PREFIX, _maint_start)
+#define mm_maint_stop   MM_PASTE(MM_PREFIX, _maint_stop)
+#define team            MM_PASTE(MM_PREFIX, _team)
+#endif
+
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 
+/*
+ * Expected lifetimes that callers may pass to mm_malloc_hint(), so
+ * that the allocator can keep blocks of different lifetimes apart.
+ * There are at most four, as mm.c keeps them in two bits of a tag.
+ */
+enum {
+    MM_HINT_NONE,         /* unknown, as for mm_malloc */
+    MM_HINT_REQUEST,      /* freed by the end of the current request */
+    MM_HINT_SESSION,      /* lives as long as a session */
+    MM_HINT_PERMANENT,    /* effectively never freed */
+    MM_HINTS
+};
+
+extern void *mm_malloc_hint(size_t size, int hint);
+
+/*
+ * Policies by which the allocator picks a free block for a request.
+ * Best fit keeps each free list sorted by size, the others push freed
+ * blocks on the front of their list.
+ */
+enum {
+    MM_FIT_FIRST,         /* first block that is large enough */
+    MM_FIT_NEXT,          /* first fit from where the last search ended */
+    MM_FIT_BEST,          /* smallest block that is large enough */
+    MM_FIT_GOOD,          /* best of the first few blocks that fit */
+    MM_FIT_POLICIES
+};
+
+/*
+ * Allocators behind the mm_ interface, chosen by mm_init(). The buddy
+ * backend (mm_buddy.c) rounds every block up to a power of two and
+ * ignores the placement parameters and hints. The rounding alone takes
+ * random-bal.rep past MAX_HEAP, so buddy cannot run the whole default
+ * trace set.
+ */
+enum {
+    MM_BACKEND_SEGFIT,    /* segregated fits with boundary tags */
+    MM_BACKEND_BUDDY      /* binary buddy system */
+};
+
+/*
+ * Heap occupancy as seen by the allocator. Every heap byte is in an
+ * allocated block, in a free block, or in allocator bookkeeping outside
+ * of any block (prologue, epilogue, alignment padding).
+ */
+typedef struct {
+    size_t heap_bytes;    /* total heap size, as mem_heapsize() */
+    size_t alloc_bytes;   /* bytes in allocated blocks, incl. their tags */
+    size_t alloc_blocks;  /* number of allocated blocks */
+    size_t free_bytes;    /* bytes in free blocks */
+    size_t free_blocks;   /* number of free blocks */
+    size_t largest_free;  /* size of the largest free block */
+
+    /* searches for a free block since mm_init, and the blocks examined */
+    size_t fit_searches[MM_FIT_POLICIES];
+    size_t fit_examined[MM_FIT_POLICIES];
+
+    /* heap extensions for a request and by the maintenance thread, and
+       resident bytes of free blocks that the maintenance thread
+       released */
+    size_t extends;
+    size_t maint_extends;
+    size_t maint_released;
+} mm_heapstats_t;
+
+extern void mm_heapstats(mm_heapstats_t *stats);
+
+/*
+ * Run-time parameters of the allocator. mm_config() sets them for the
+ * following mm_init() calls, NULL restores the compiled-in defaults.
+ */
+typedef struct {
+    size_t chunksize;     /* bytes by which the heap grows at least */
+    int bins;             /* number of segregated free lists in use */
+    int bin_sub;          /* log2 of free lists per power of two of size */
+    size_t split_min;     /* smallest remainder that is split off a block */
+    int fit_limit;        /* free blocks a search examines, 0 = no limit */
+    int fit_policy;       /* MM_FIT_FIRST, ... */
+    int fit_good;         /* fitting blocks a good-fit search compares */
+    size_t fit_slack;     /* good fit takes a block wasting less than this */
+    size_t place_high;    /* place requests this large at the high end of
+                             a free block, 0 = always at the low end */
+    size_t quick_max;     /* defer freeing blocks up to this size, 0 = off */
+    int quick_batch;      /* deferred frees that trigger a consolidation */
+    int backend;          /* MM_BACKEND_SEGFIT or MM_BACKEND_BUDDY */
+} mm_config_t;
+
+extern void mm_config(const mm_config_t *config);
+extern void mm_get_config(mm_config_t *config);
+
+/*
+ * Relocatable blocks. mm_halloc() returns a handle instead of a
+ * pointer, and mm_compact() may move the block of any handle that is
+ * not pinned. mm_hpin() returns the current address of the payload,
+ * which stays valid until the matching mm_hunpin(); pins nest.
+ * mm_compact() slides unpinned handle blocks down over free space,
+ * returns the free space left at the top of the heap to memlib, and
+ * returns the number of bytes it gave back.
+ */
+typedef int mm_handle_t;
+#define MM_HNULL (-1)
+
+extern mm_handle_t mm_halloc(size_t size);
+extern void mm_hfree(mm_handle_t h);
+extern void *mm_hpin(mm_handle_t h);
+extern void mm_hunpin(mm_handle_t h);
+extern size_t mm_compact(void);
+
+/*
+ * Persistent heaps. When memlib maps a heap file (mem_init_file), the
+ * allocator keeps its roots in the heap, and a later process attaches
+ * to the heap with mm_attach() instead of calling mm_init(). The caller
+ * finds its own data again through the pointer it gave mm_set_root().
+ * mm_snapshot() copies such a heap into a template, and processes that
+ * map the template copy-on-write (mem_init_snapshot) start with the
+ * heap and its data prebuilt by calling mm_attach().
+ */
+extern int mm_attach(void);
+extern void mm_set_root(void *p);
+extern void *mm_get_root(void);
+extern int mm_snapshot(void);
+
+/*
+ * Maintenance thread. mm_maint_start() starts a thread that every
+ * period_us microseconds frees the deferred frees, releases the pages
+ * inside large free blocks, and extends the heap and faults in the new
+ * pages ahead of its recent growth, so that requests seldom extend the
+ * heap or touch a new page themselves. The mm_ calls then take a lock,
+ * but are still not safe to make from several threads at once.
+ * mm_maint_stop() stops the thread, as do mm_init() and mm_attach(); it
+ * must be stopped before memlib is reset.
+ */
+extern int mm_maint_start(int period_us);
+extern void mm_maint_stop(void);
+
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
@@ -21,3 +189,4 @@ typedef struct {
 
 extern team_t team;
 
+#endif /* __MM_H_ */
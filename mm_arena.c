@@ -0,0 +1,138 @@
+/*
+ * mm_arena.c - Arenas of short-lived objects on top of the mm heap
+ *
+ * The chunks of an arena form a list, newest first, and allocation
+ * bumps a pointer through the newest one. A request that would take
+ * more than a quarter of a chunk gets a chunk of its own, which goes
+ * behind the newest chunk so that the space left in that one is not
+ * lost. The arena header and all chunks come from mm_malloc.
+ */
+#include "mm_arena.h"
+#include "mm.h"
+
+/* the block alignment of mm.c */
+#define ARENA_ALIGN (2 * sizeof(void *))
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;  /* next older chunk */
+    size_t size;               /* bytes, this header included */
+} arena_chunk_t;
+
+#define CHUNK_HDR ARENA_ROUND(sizeof(arena_chunk_t))
+
+struct mm_arena {
+    size_t chunk_size;         /* bytes per regular chunk */
+    arena_chunk_t *chunks;     /* newest first */
+    char *next;                /* free space in the newest chunk ... */
+    char *end;                 /* ... up to here */
+};
+
+/* get a chunk of size bytes from mm_malloc */
+static arena_chunk_t *new_chunk(size_t size)
+{
+    arena_chunk_t *c;
+
+    if ((c = (arena_chunk_t *)mm_malloc(size)) == NULL)
+	return NULL;
+    c->size = size;
+    c->next = NULL;
+    return c;
+}
+
+/*
+ * mm_arena_create - a new empty arena that grows by chunks of
+ *     chunk_size bytes, or MM_ARENA_CHUNK if chunk_size is 0. Returns
+ *     NULL if mm_malloc fails.
+ */
+mm_arena_t *mm_arena_create(size_t chunk_size)
+{
+    mm_arena_t *a;
+
+    if ((a = (mm_arena_t *)mm_malloc(sizeof(mm_arena_t))) == NULL)
+	return NULL;
+    if (chunk_size == 0)
+	chunk_size = MM_ARENA_CHUNK;
+    a->chunk_size = ARENA_ROUND(chunk_size);
+    if (a->chunk_size < 2 * CHUNK_HDR)
+	a->chunk_size = 2 * CHUNK_HDR;
+    a->chunks = NULL;
+    a->next = a->end = NULL;
+    return a;
+}
+
+/*
+ * mm_arena_alloc - size bytes from arena, aligned as mm_malloc would
+ *     align them. Returns NULL if mm_malloc fails.
+ */
+void *mm_arena_alloc(mm_arena_t *a, size_t size)
+{
+    arena_chunk_t *c;
+    char *p;
+
+    size = ARENA_ROUND(size ? size : 1);
+    if (size <= (size_t)(a->end - a->next)) {
+	p = a->next;
+	a->next += size;
+	return p;
+    }
+
+    /* A large object gets a chunk of its own behind the newest one */
+    if (size > (a->chunk_size - CHUNK_HDR) / 4) {
+	if ((c = new_chunk(CHUNK_HDR + size)) == NULL)
+	    return NULL;
+	if (a->chunks != NULL) {
+	    c->next = a->chunks->next;
+	    a->chunks->next = c;
+	} else
+	    a->chunks = c;
+	return (char *)c + CHUNK_HDR;
+    }
+
+    if ((c = new_chunk(a->chunk_size)) == NULL)
+	return NULL;
+    c->next = a->chunks;
+    a->chunks = c;
+    p = (char *)c + CHUNK_HDR;
+    a->next = p + size;
+    a->end = (char *)c + c->size;
+    return p;
+}
+
+/*
+ * mm_arena_reset - free every object of arena at once. The oldest
+ *     chunk is kept for the next round of allocations if it is a
+ *     regular one, all other chunks go back to mm_free.
+ */
+void mm_arena_reset(mm_arena_t *a)
+{
+    arena_chunk_t *c, *next, *keep = NULL;
+
+    for (c = a->chunks; c != NULL; c = next) {
+	next = c->next;
+	if (next == NULL && c->size == a->chunk_size)
+	    keep = c;
+	else
+	    mm_free(c);
+    }
+    a->chunks = keep;
+    if (keep != NULL) {
+	a->next = (char *)keep + CHUNK_HDR;
+	a->end = (char *)keep + keep->size;
+    } else
+	a->next = a->end = NULL;
+}
+
+/*
+ * mm_arena_destroy - free every object of arena, and arena itself
+ */
+void mm_arena_destroy(mm_arena_t *a)
+{
+    arena_chunk_t *c, *next;
+
+    for (c = a->chunks; c != NULL; c = next) {
+	next = c->next;
+	mm_free(c);
+    }
+    mm_free(a);
+}
@@ -0,0 +1,25 @@
+/*
+ * mm_arena.h - Arenas of short-lived objects on top of the mm heap
+ *
+ * An arena hands out memory by bumping a pointer through chunks that
+ * it takes from mm_malloc, and gives back all of its objects at once:
+ * mm_arena_reset frees every chunk but one, and mm_arena_destroy frees
+ * the arena itself as well. Objects cannot be freed one by one. This
+ * suits work that allocates many small objects per request and drops
+ * them all when the request is done.
+ */
+#ifndef __MM_ARENA_H_
+#define __MM_ARENA_H_
+
+#include <stddef.h>
+
+#define MM_ARENA_CHUNK 4096 /* default chunk size in bytes */
+
+typedef struct mm_arena mm_arena_t;
+
+mm_arena_t *mm_arena_create(size_t chunk_size);
+void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+void mm_arena_reset(mm_arena_t *arena);
+void mm_arena_destroy(mm_arena_t *arena);
+
+#endif /* __MM_ARENA_H_ */
@@ -0,0 +1,293 @@
+/*
+ * mm_buddy.c - Binary buddy backend of mm.c
+ *
+ * Every block is 2^k bytes for an order k between min_order (room for
+ * the two free-list links) and the order of the whole heap, and starts
+ * at a multiple of its size from the heap base, so the buddy of the
+ * block at offset off is at off ^ 2^k. Blocks have no header or
+ * footer. Instead two bitmaps outside the heap, with a bit per possible
+ * block of each order, say whether that block is split into two halves
+ * and whether it is free. Free blocks of each order are on a doubly
+ * linked list, so a free merges with its buddy in constant time per
+ * order, and the order of a block being freed is found by following
+ * the split bits down from the root.
+ *
+ * The heap is a single buddy tree of which only the first top bytes
+ * exist. When it runs out of space it grows at top by one piece, a
+ * block of the order of the request (at least BUDDY_GROW_ORDER) or of
+ * the largest order that top is aligned to, whichever is smaller. The
+ * root moves up an order whenever a piece would reach past it. Every
+ * block that contains a piece is marked split, so blocks past top are
+ * never on a free list and a free merges with its buddy only if that
+ * exists. The heap thus ends up at most a piece larger than it needs,
+ * rather than twice as large as the tree it would have needed.
+ */
+#include <string.h>
+#include <limits.h>
+
+#include "mm_buddy.h"
+#include "memlib.h"
+#include "config.h"
+
+#define BUDDY_MIN_ALIGN (2 * sizeof(void *))  /* mm.c block alignment */
+#define BUDDY_MAX_ORDER 25                     /* largest heap, 32 MB */
+#define BUDDY_MIN_ORDER 3                      /* smallest min_order */
+#define BUDDY_GROW_ORDER 12                    /* smallest piece, 4 KB */
+
+/* The whole modeled heap must fit in the largest tree */
+typedef char buddy_covers_heap[((1L << BUDDY_MAX_ORDER) >= MAX_HEAP) ? 1 : -1];
+
+/* bits for the blocks of all orders */
+#define BUDDY_BITS  (1L << (BUDDY_MAX_ORDER - BUDDY_MIN_ORDER + 1))
+#define WORD_BITS   (sizeof(unsigned long) * CHAR_BIT)
+
+#define PRED(bp) (*(char **)(bp))
+#define SUCC(bp) (*(char **)((bp) + sizeof(char *)))
+
+static char *base;            /* offset 0 of the tree */
+static int min_order;         /* order of the smallest block */
+static int root_order;        /* order of the whole tree */
+static size_t top;            /* bytes of the tree that exist */
+static char *free_list[BUDDY_MAX_ORDER + 1];
+static long bit_base[BUDDY_MAX_ORDER + 1];  /* first bit of each order */
+static unsigned long split_map[BUDDY_BITS / WORD_BITS];
+static unsigned long free_map[BUDDY_BITS / WORD_BITS];
+static size_t alloc_bytes, alloc_blocks, free_blocks;
+
+/* bit of the block of order k at offset off */
+static inline long bit_of(int k, size_t off)
+{
+    return bit_base[k] + (long)(off >> k);
+}
+
+static inline int test_bit(unsigned long *map, long b)
+{
+    return (map[b / WORD_BITS] >> (b % WORD_BITS)) & 1;
+}
+
+static inline void set_bit(unsigned long *map, long b, int v)
+{
+    if (v)
+	map[b / WORD_BITS] |= 1UL << (b % WORD_BITS);
+    else
+	map[b / WORD_BITS] &= ~(1UL << (b % WORD_BITS));
+}
+
+/* smallest order whose blocks hold size bytes */
+static int order_of(size_t size)
+{
+    int k = min_order;
+
+    while (((size_t)1 << k) < size)
+	k++;
+    return k;
+}
+
+/* put the block at off on the free list of order k */
+static void push_free(int k, size_t off)
+{
+    char *bp = base + off;
+
+    PRED(bp) = NULL;
+    SUCC(bp) = free_list[k];
+    if (free_list[k] != NULL)
+	PRED(free_list[k]) = bp;
+    free_list[k] = bp;
+    set_bit(free_map, bit_of(k, off), 1);
+    free_blocks++;
+}
+
+/* take the block at off off the free list of order k */
+static void remove_free(int k, size_t off)
+{
+    char *bp = base + off;
+
+    if (PRED(bp) != NULL)
+	SUCC(PRED(bp)) = SUCC(bp);
+    else
+	free_list[k] = SUCC(bp);
+    if (SUCC(bp) != NULL)
+	PRED(SUCC(bp)) = PRED(bp);
+    set_bit(free_map, bit_of(k, off), 0);
+    free_blocks--;
+}
+
+/*
+ * release - free the block of order k at off, merging it with its
+ *     buddy for as long as that is free
+ */
+static void release(int k, size_t off)
+{
+    size_t buddy;
+
+    while (k < root_order) {
+	buddy = off ^ ((size_t)1 << k);
+	if (!test_bit(free_map, bit_of(k, buddy)))
+	    break;
+	remove_free(k, buddy);
+	off &= ~((size_t)1 << k);
+	k++;
+	set_bit(split_map, bit_of(k, off), 0);
+    }
+    push_free(k, off);
+}
+
+/*
+ * grow - extend the tree at top by one piece on the way to a free
+ *     block of order k. The piece becomes a free block, which merges
+ *     with its buddy if that is free.
+ */
+static int grow(int k)
+{
+    int p = (k > BUDDY_GROW_ORDER) ? k : BUDDY_GROW_ORDER;
+    size_t off = top;
+    size_t size;
+    int j;
+
+    while (off % ((size_t)1 << p) != 0)
+	p--;
+    size = (size_t)1 << p;
+    if (off + size > ((size_t)1 << BUDDY_MAX_ORDER) ||
+	mem_sbrk(size) == (void *)-1)
+	return -1;
+    while (off + size > ((size_t)1 << root_order))
+	root_order++;
+    for (j = p + 1; j <= root_order; j++)
+	set_bit(split_map, bit_of(j, off & ~(((size_t)1 << j) - 1)), 1);
+    top = off + size;
+    release(p, off);
+    return 0;
+}
+
+/*
+ * buddy_init - start with a tree of at least initial bytes
+ */
+int buddy_init(size_t initial)
+{
+    size_t pad;
+    long bits = 0;
+    int k;
+
+    pad = (BUDDY_MIN_ALIGN - (size_t)mem_heap_lo() % BUDDY_MIN_ALIGN) %
+	BUDDY_MIN_ALIGN;
+    if (pad > 0 && mem_sbrk(pad) == (void *)-1)
+	return -1;
+    base = (char *)mem_heap_lo() + pad;
+
+    for (min_order = BUDDY_MIN_ORDER;
+	 ((size_t)1 << min_order) < 2 * sizeof(char *); min_order++)
+	;
+    for (k = 0; k <= BUDDY_MAX_ORDER; k++) {
+	free_list[k] = NULL;
+	bit_base[k] = bits;
+	if (k >= min_order)
+	    bits += 1L << (BUDDY_MAX_ORDER - k);
+    }
+    memset(split_map, 0, sizeof(split_map));
+    memset(free_map, 0, sizeof(free_map));
+    alloc_bytes = alloc_blocks = free_blocks = 0;
+
+    root_order = order_of(initial);
+    if (root_order > BUDDY_MAX_ORDER ||
+	mem_sbrk((size_t)1 << root_order) == (void *)-1)
+	return -1;
+    top = (size_t)1 << root_order;
+    push_free(root_order, 0);
+    return 0;
+}
+
+/*
+ * buddy_malloc - take the smallest free block that holds size bytes,
+ *     halving it down to the order of the request
+ */
+void *buddy_malloc(size_t size)
+{
+    int j, k;
+    size_t off;
+
+    if (size == 0 || size > ((size_t)1 << BUDDY_MAX_ORDER))
+	return NULL;
+    k = order_of(size);
+    for (;;) {
+	for (j = k; j <= root_order && free_list[j] == NULL; j++)
+	    ;
+	if (j <= root_order)
+	    break;
+	if (grow(k) < 0)
+	    return NULL;
+    }
+
+    off = free_list[j] - base;
+    remove_free(j, off);
+    for (; j > k; j--) {
+	set_bit(split_map, bit_of(j, off), 1);
+	push_free(j - 1, off + ((size_t)1 << (j - 1)));
+    }
+    alloc_bytes += (size_t)1 << k;
+    alloc_blocks++;
+    return base + off;
+}
+
+/* order of the allocated block at off, from the split bits */
+static int block_order(size_t off)
+{
+    int k = root_order;
+
+    while (k > min_order && test_bit(split_map, bit_of(k, off)))
+	k--;
+    return k;
+}
+
+/*
+ * buddy_free - free a block and merge it with its free buddies
+ */
+void buddy_free(void *ptr)
+{
+    size_t off = (char *)ptr - base;
+    int k = block_order(off);
+
+    alloc_bytes -= (size_t)1 << k;
+    alloc_blocks--;
+    release(k, off);
+}
+
+/*
+ * buddy_realloc - keep the block if size still needs its order
+ */
+void *buddy_realloc(void *ptr, size_t size)
+{
+    size_t off = (char *)ptr - base;
+    size_t old = (size_t)1 << block_order(off);
+    void *newptr;
+
+    if (size <= old && (size > old / 2 || old == ((size_t)1 << min_order)))
+	return ptr;
+    if ((newptr = buddy_malloc(size)) == NULL)
+	return NULL;
+    memcpy(newptr, ptr, size < old ? size : old);
+    buddy_free(ptr);
+    return newptr;
+}
+
+/*
+ * buddy_heapstats - heap occupancy, from the counters kept by malloc
+ *     and free. The alignment padding before the tree counts as
+ *     neither allocated nor free.
+ */
+void buddy_heapstats(mm_heapstats_t *stats)
+{
+    int k;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->heap_bytes = mem_heapsize();
+    stats->alloc_bytes = alloc_bytes;
+    stats->alloc_blocks = alloc_blocks;
+    stats->free_bytes = top - alloc_bytes;
+    stats->free_blocks = free_blocks;
+    for (k = root_order; k >= min_order; k--) {
+	if (free_list[k] != NULL) {
+	    stats->largest_free = (size_t)1 << k;
+	    break;
+	}
+    }
+}
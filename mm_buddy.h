@@ -0,0 +1,15 @@
+/*
+ * mm_buddy.h - Binary buddy backend of mm.c (see MM_BACKEND_BUDDY)
+ */
+#ifndef __MM_BUDDY_H_
+#define __MM_BUDDY_H_
+
+#include "mm.h"
+
+int buddy_init(size_t initial);
+void *buddy_malloc(size_t size);
+void buddy_free(void *ptr);
+void *buddy_realloc(void *ptr, size_t size);
+void buddy_heapstats(mm_heapstats_t *stats);
+
+#endif /* __MM_BUDDY_H_ */
@@ -0,0 +1,68 @@
+/*
+ * mm_null.c - A null allocator for measuring the cost of the driver
+ *
+ * Allocation bumps a pointer through the modeled heap and wraps around
+ * at its end, free does nothing, and realloc is a malloc that does not
+ * copy. Nothing is ever written through the returned pointers, so a
+ * trace replayed against this package costs only the replay loop plus
+ * the calls themselves. The functions live in their own file so that
+ * the compiler cannot inline them into the driver and make the loop
+ * look cheaper than it is for a real allocator.
+ */
+#include "mm_null.h"
+#include "memlib.h"
+#include "config.h"
+
+/* rounds up to the nearest multiple of ALIGNMENT */
+#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
+
+static char *null_brk;  /* next address to hand out */
+static char *null_end;  /* wrap around here */
+
+/*
+ * null_init - Start handing out addresses at the bottom of the heap
+ */
+int null_init(void)
+{
+    null_brk = (char *)mem_heap_lo();
+    null_end = null_brk + MAX_HEAP;
+    return 0;
+}
+
+/*
+ * null_malloc - Bump the pointer, wrapping when the heap is exhausted
+ */
+void *null_malloc(size_t size)
+{
+    char *p;
+
+    size = ALIGN(size);
+    if (null_brk + size > null_end)
+	null_brk = (char *)mem_heap_lo();
+    p = null_brk;
+    null_brk += size;
+    return p;
+}
+
+/*
+ * null_malloc_hint - Ignore the hint
+ */
+void *null_malloc_hint(size_t size, int hint)
+{
+    return null_malloc(size);
+}
+
+/*
+ * null_free - Do nothing
+ */
+void null_free(void *ptr)
+{
+}
+
+/*
+ * null_realloc - Hand out a new block without copying the old one
+ */
+void *null_realloc(void *ptr, size_t size)
+{
+    return null_malloc(size);
+}
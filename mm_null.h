@@ -0,0 +1,15 @@
+/*
+ * mm_null.h - A null allocator for measuring the cost of the driver
+ */
+#ifndef __MM_NULL_H_
+#define __MM_NULL_H_
+
+#include <stddef.h>
+
+int null_init(void);
+void *null_malloc(size_t size);
+void *null_malloc_hint(size_t size, int hint);
+void null_free(void *ptr);
+void *null_realloc(void *ptr, size_t size);
+
+#endif /* __MM_NULL_H_ */
@@ -0,0 +1,134 @@
+/*
+ * mm_registry.c - Table of malloc packages that mdriver can evaluate
+ *
+ * The compiled-in packages are "mm" plus every prefix listed in the
+ * MM_VARIANTS macro, which the Makefile builds from its VARIANTS
+ * variable as X(prefix1) X(prefix2) ... Each such prefix names a copy
+ * of mm.c compiled with -DMM_PREFIX=prefix, so that its mm_init,
+ * mm_malloc, ... are linked as prefix_init, prefix_malloc, ... and its
+ * static state is separate from that of every other copy.
+ *
+ * A name containing a '/' or ending in ".so", optionally written as
+ * label=path, is loaded with dlopen instead. The shared object must
+ * export mm_init, mm_malloc, mm_free and mm_realloc, and may export
+ * mm_malloc_hint, mm_heapstats, mm_config and mm_get_config. It calls memlib in the
+ * driver, which is why mdriver is linked with -rdynamic; it should
+ * itself be linked with -Bsymbolic so that its internal calls to
+ * mm_malloc and friends do not bind to the driver's own copies (the
+ * Makefile's %.so rule does both).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include "mm_registry.h"
+
+#ifndef MM_VARIANTS
+#define MM_VARIANTS
+#endif
+
+/* declare the entry points of each variant */
+#define X(p)                                            \
+    extern int p##_init(void);                          \
+    extern void *p##_malloc(size_t size);               \
+    extern void p##_free(void *ptr);                    \
+    extern void *p##_realloc(void *ptr, size_t size);   \
+    extern void p##_heapstats(mm_heapstats_t *stats);   \
+    extern void p##_config(const mm_config_t *config);  \
+    extern void p##_get_config(mm_config_t *config);   \
+    extern void *p##_malloc_hint(size_t size, int hint);
+MM_VARIANTS
+#undef X
+
+#define X(p) {#p, p##_init, p##_malloc, p##_free, p##_realloc, \
+	p##_heapstats, p##_config, p##_get_config, p##_malloc_hint},
+
+static mm_allocator_t builtin[] = {
+    {"mm", mm_init, mm_malloc, mm_free, mm_realloc, mm_heapstats,
+     mm_config, mm_get_config, mm_malloc_hint},
+    MM_VARIANTS
+};
+#undef X
+
+#define NBUILTIN ((int)(sizeof(builtin) / sizeof(builtin[0])))
+
+/*
+ * mm_allocator_count - number of compiled-in packages
+ */
+int mm_allocator_count(void)
+{
+    return NBUILTIN;
+}
+
+/*
+ * mm_allocator_at - the i-th compiled-in package
+ */
+const mm_allocator_t *mm_allocator_at(int i)
+{
+    return (i >= 0 && i < NBUILTIN) ? &builtin[i] : NULL;
+}
+
+/* load a package from the shared object at path */
+static const mm_allocator_t *load_shared(const char *label, const char *path)
+{
+    mm_allocator_t *a;
+    void *handle;
+
+    if ((handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+	fprintf(stderr, "mm_registry: %s\n", dlerror());
+	return NULL;
+    }
+    if ((a = calloc(1, sizeof(*a))) == NULL) {
+	dlclose(handle);
+	return NULL;
+    }
+    *(void **)&a->init = dlsym(handle, "mm_init");
+    *(void **)&a->malloc = dlsym(handle, "mm_malloc");
+    *(void **)&a->free = dlsym(handle, "mm_free");
+    *(void **)&a->realloc = dlsym(handle, "mm_realloc");
+    *(void **)&a->heapstats = dlsym(handle, "mm_heapstats");
+    *(void **)&a->config = dlsym(handle, "mm_config");
+    *(void **)&a->get_config = dlsym(handle, "mm_get_config");
+    *(void **)&a->malloc_hint = dlsym(handle, "mm_malloc_hint");
+    if (!a->init || !a->malloc || !a->free || !a->realloc) {
+	fprintf(stderr, "mm_registry: %s does not export the mm_ interface\n",
+		path);
+	free(a);
+	dlclose(handle);
+	return NULL;
+    }
+    if ((a->name = strdup(label)) == NULL) {
+	free(a);
+	dlclose(handle);
+	return NULL;
+    }
+    return a;
+}
+
+/*
+ * mm_allocator_lookup - find a compiled-in package by name, or load
+ *     one from a shared object given as "path" or "label=path". Returns
+ *     NULL if there is no such package.
+ */
+const mm_allocator_t *mm_allocator_lookup(const char *name)
+{
+    const char *eq, *base;
+    char label[256];
+    size_t len = strlen(name);
+    int i;
+
+    if (strchr(name, '/') != NULL ||
+	(len > 3 && strcmp(name + len - 3, ".so") == 0)) {
+	if ((eq = strchr(name, '=')) != NULL) {
+	    snprintf(label, sizeof(label), "%.*s", (int)(eq - name), name);
+	    return load_shared(label, eq + 1);
+	}
+	base = strrchr(name, '/');
+	return load_shared(base ? base + 1 : name, name);
+    }
+
+    for (i = 0; i < NBUILTIN; i++)
+	if (strcmp(builtin[i].name, name) == 0)
+	    return &builtin[i];
+    return NULL;
+}
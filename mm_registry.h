@@ -0,0 +1,30 @@
+/*
+ * mm_registry.h - Table of malloc packages that mdriver can evaluate
+ *
+ * Every package is described by an mm_allocator_t holding its entry
+ * points. mm.c itself is always registered as "mm". Further packages
+ * are either linked in under their own symbol prefix (see VARIANTS in
+ * the Makefile) or loaded at run time from a shared object.
+ */
+#ifndef __MM_REGISTRY_H_
+#define __MM_REGISTRY_H_
+
+#include "mm.h"
+
+typedef struct {
+    const char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void (*heapstats)(mm_heapstats_t *stats);  /* may be NULL */
+    void (*config)(const mm_config_t *config); /* may be NULL */
+    void (*get_config)(mm_config_t *config);   /* may be NULL */
+    void *(*malloc_hint)(size_t size, int hint); /* may be NULL */
+} mm_allocator_t;
+
+int mm_allocator_count(void);
+const mm_allocator_t *mm_allocator_at(int i);
+const mm_allocator_t *mm_allocator_lookup(const char *name);
+
+#endif /* __MM_REGISTRY_H_ */
@@ -0,0 +1,201 @@
+/*
+ * perfctr.c - Hardware and software event counters via perf_event_open
+ *
+ * Every event is opened as its own counter rather than as a group, so
+ * that one unsupported event cannot take the others down with it.
+ * Hardware events count user space only, which is all that unprivileged
+ * processes may see under the default perf_event_paranoid. Software
+ * events also count in the kernel where that is allowed, and user space
+ * only where it is not.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/* Cache events are encoded as cache | (op << 8) | (result << 16) */
+#define CACHE_EVENT(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const char *event_names[PERF_NEVENTS] = {
+    "cycles", "instrs", "L1d-miss", "LLC-miss",
+    "dTLB-miss", "br-miss", "faults", "ctxsw"
+};
+
+static int fds[PERF_NEVENTS];      /* counter fds, -1 if unavailable */
+static int initialized = 0;
+
+#ifdef __linux__
+/* Value of a counter opened with TOTAL_TIME_ENABLED|TOTAL_TIME_RUNNING */
+struct read_format {
+    unsigned long long value;
+    unsigned long long time_enabled;
+    unsigned long long time_running;
+};
+
+/*
+ * open one counter for this thread, initially disabled. Hardware events
+ * count user space only; software events such as context switches and
+ * page faults happen in the kernel, so they count it too unless the
+ * system does not allow that.
+ */
+static int open_event(unsigned type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = (type != PERF_TYPE_SOFTWARE);
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0 && errno == EACCES && !attr.exclude_kernel) {
+	attr.exclude_kernel = 1;
+	fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    return fd;
+}
+#endif
+
+/*
+ * perf_init - Open as many of the counters as the system allows and
+ *     return how many were opened. With verbose set, explain which
+ *     events are missing and why.
+ */
+int perf_init(int verbose)
+{
+    int i, n = 0;
+#ifdef __linux__
+    static const struct {
+	unsigned type;
+	unsigned long long config;
+    } events[PERF_NEVENTS] = {
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D)},
+	{PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_LL)},
+	{PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB)},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+	{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    };
+    int hw = 0;
+
+    if (initialized)
+	perf_deinit();
+    for (i = 0; i < PERF_NEVENTS; i++) {
+	fds[i] = open_event(events[i].type, events[i].config);
+	if (fds[i] >= 0) {
+	    n++;
+	    if (events[i].type != PERF_TYPE_SOFTWARE)
+		hw++;
+	}
+	else if (verbose > 1) {
+	    printf("perf: %s unavailable: %s\n", event_names[i],
+		   strerror(errno));
+	}
+    }
+    if (hw == 0)
+	printf("perf: hardware counters unavailable, "
+	       "reporting software events only\n");
+#else
+    for (i = 0; i < PERF_NEVENTS; i++)
+	fds[i] = -1;
+    printf("perf: event counters are only supported on Linux\n");
+#endif
+    initialized = 1;
+    return n;
+}
+
+/*
+ * perf_start - Reset and enable all open counters
+ */
+void perf_start(void)
+{
+#ifdef __linux__
+    int i;
+
+    for (i = 0; i < PERF_NEVENTS; i++) {
+	if (fds[i] < 0)
+	    continue;
+	ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+/*
+ * perf_stop - Disable all open counters and read them into *counts.
+ *     If the kernel had to multiplex a counter, its value is scaled up
+ *     by the fraction of time it was actually running.
+ */
+void perf_stop(perf_counts_t *counts)
+{
+    int i;
+#ifdef __linux__
+    struct read_format rf;
+
+    for (i = 0; i < PERF_NEVENTS; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    for (i = 0; i < PERF_NEVENTS; i++) {
+	counts->valid[i] = 0;
+	counts->value[i] = 0;
+#ifdef __linux__
+	if (fds[i] < 0 || read(fds[i], &rf, sizeof(rf)) != sizeof(rf))
+	    continue;
+	if (rf.time_running == 0)
+	    continue;
+	if (rf.time_running < rf.time_enabled)
+	    rf.value = (unsigned long long)
+		((double)rf.value * rf.time_enabled / rf.time_running);
+	counts->valid[i] = 1;
+	counts->value[i] = rf.value;
+#endif
+    }
+}
+
+/*
+ * perf_deinit - Close all counters
+ */
+void perf_deinit(void)
+{
+    int i;
+
+    for (i = 0; i < PERF_NEVENTS; i++) {
+	if (initialized && fds[i] >= 0)
+	    close(fds[i]);
+	fds[i] = -1;
+    }
+    initialized = 0;
+}
+
+/*
+ * perf_event_name - Short column name of an event
+ */
+const char *perf_event_name(int event)
+{
+    return event_names[event];
+}
+
+/*
+ * perf_event_available - Was the event opened by perf_init?
+ */
+int perf_event_available(int event)
+{
+    return initialized && fds[event] >= 0;
+}
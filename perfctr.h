@@ -0,0 +1,38 @@
+/*
+ * perfctr.h - Hardware and software event counters via perf_event_open
+ *
+ * The counters are opened once by perf_init() and then enabled around
+ * each measured region. Any event the kernel refuses (no PMU in the
+ * container, perf_event_paranoid too strict, unsupported cache event)
+ * is simply marked unavailable; the software events normally remain.
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+/* The events we try to count, in reporting order */
+enum {
+    PERF_CYCLES,        /* CPU cycles */
+    PERF_INSTRUCTIONS,  /* retired instructions */
+    PERF_L1D_MISSES,    /* L1 data cache read misses */
+    PERF_LLC_MISSES,    /* last level cache read misses */
+    PERF_DTLB_MISSES,   /* data TLB read misses */
+    PERF_BRANCH_MISSES, /* mispredicted branches */
+    PERF_PAGE_FAULTS,   /* page faults (software) */
+    PERF_CTX_SWITCHES,  /* context switches (software) */
+    PERF_NEVENTS
+};
+
+/* Event counts for one measured region */
+typedef struct {
+    int valid[PERF_NEVENTS];                /* was this event counted? */
+    unsigned long long value[PERF_NEVENTS]; /* scaled for multiplexing */
+} perf_counts_t;
+
+int perf_init(int verbose);
+void perf_start(void);
+void perf_stop(perf_counts_t *counts);
+void perf_deinit(void);
+const char *perf_event_name(int event);
+int perf_event_available(int event);
+
+#endif /* __PERFCTR_H_ */
@@ -0,0 +1,203 @@
+/*
+ * persistbench.c - Cold build against warm restart of a file-backed heap
+ *
+ * usage: persistbench [-f <heap file>] [-n <objects>] [-s <max size>]
+ *
+ * The first run finds no heap in the file, so it calls mm_init and
+ * builds a linked list of n objects filled with a checksummed pattern,
+ * and leaves the heap in the file. The next run maps the file again
+ * and calls mm_attach instead, finds the list through mm_get_root,
+ * checks every object, and then frees and reallocates a share of them
+ * to show that the allocator carries on where the last run stopped.
+ * Remove the file to start over.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+
+/* An object of the list */
+typedef struct obj {
+    struct obj *next;
+    int size;                /* bytes of data */
+    unsigned sum;            /* checksum of data */
+    unsigned char data[];
+} obj_t;
+
+/* Benchmark parameters */
+typedef struct {
+    char *path;              /* heap file */
+    int objects;             /* objects in the list */
+    int max_size;            /* data sizes are uniform in 1..max_size */
+    int warm;                /* the file held a heap */
+    int attached;            /* mm_attach found it complete */
+    int bad;                 /* objects whose checksum failed */
+    int count;               /* objects found */
+} bench_t;
+
+int verbose = 0;             /* read by the timer routines */
+
+static void app_error(char *msg)
+{
+    fprintf(stderr, "persistbench: %s\n", msg);
+    exit(1);
+}
+
+static unsigned checksum(const unsigned char *p, int n)
+{
+    unsigned sum = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+	sum = sum * 31 + p[i];
+    return sum;
+}
+
+/* new_obj - allocate an object with size bytes of pattern */
+static obj_t *new_obj(int size)
+{
+    obj_t *o;
+    int i;
+
+    if ((o = mm_malloc(sizeof(obj_t) + size)) == NULL)
+	app_error("the heap ran out of memory");
+    o->size = size;
+    for (i = 0; i < size; i++)
+	o->data[i] = (unsigned char)rand();
+    o->sum = checksum(o->data, size);
+    return o;
+}
+
+/* build - make the list in a new heap */
+static void build(void *argp)
+{
+    bench_t *b = (bench_t *)argp;
+    obj_t *head = NULL, *o;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed");
+    for (i = 0; i < b->objects; i++) {
+	o = new_obj(1 + rand() % b->max_size);
+	o->next = head;
+	head = o;
+    }
+    mm_set_root(head);
+}
+
+/* open_heap - map the heap file and attach to the heap it holds */
+static void open_heap(void *argp)
+{
+    bench_t *b = (bench_t *)argp;
+
+    b->warm = mem_init_file(b->path);
+    b->attached = b->warm && mm_attach() == 0;
+}
+
+/* check - walk the list and count the objects whose checksum fails */
+static void check(void *argp)
+{
+    bench_t *b = (bench_t *)argp;
+    obj_t *o;
+
+    b->count = b->bad = 0;
+    for (o = mm_get_root(); o != NULL; o = o->next) {
+	b->count++;
+	if (checksum(o->data, o->size) != o->sum)
+	    b->bad++;
+    }
+}
+
+/* churn - replace every fourth object by a new one */
+static void churn(bench_t *b)
+{
+    obj_t *prev = NULL, *o, *n;
+    int i = 0;
+
+    for (o = mm_get_root(); o != NULL; prev = o, o = o->next, i++) {
+	if (i % 4 != 0)
+	    continue;
+	n = new_obj(1 + rand() % b->max_size);
+	n->next = o->next;
+	if (prev == NULL)
+	    mm_set_root(n);
+	else
+	    prev->next = n;
+	mm_free(o);
+	o = n;
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: persistbench [-f <heap file>] [-n <objects>] "
+	    "[-s <max size>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-f <file>  Heap file (persist.heap).\n");
+    fprintf(stderr, "\t-n <n>     Objects in the list (50000).\n");
+    fprintf(stderr, "\t-s <n>     Data sizes are uniform in 1..n (200).\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
+
+int main(int argc, char **argv)
+{
+    bench_t b = {"persist.heap", 50000, 200, 0, 0, 0, 0};
+    double secs_open, secs_build, secs_check;
+    int c;
+
+    while ((c = getopt(argc, argv, "f:n:s:h")) != EOF) {
+	switch (c) {
+	case 'f':
+	    b.path = optarg;
+	    break;
+	case 'n':
+	    b.objects = atoi(optarg);
+	    break;
+	case 's':
+	    b.max_size = atoi(optarg);
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (b.objects < 1 || b.max_size < 1)
+	app_error("objects and sizes must be positive");
+
+    init_fsecs();
+    srand(1);
+    secs_open = ftimer_gettod(open_heap, &b, 1);
+    if (!b.attached) {
+	secs_build = ftimer_gettod(build, &b, 1);
+	check(&b);
+	printf("cold start: mapped %s in %.3f ms, built %d objects in "
+	       "%.3f ms\n", b.path, secs_open * 1e3, b.count, secs_build * 1e3);
+	printf("run again to attach to the heap\n");
+	mem_deinit();
+	exit(0);
+    }
+
+    secs_check = ftimer_gettod(check, &b, 1);
+    printf("warm start: attached to %s (%.0f KB) in %.3f ms\n", b.path,
+	   mem_heapsize() / 1024.0, secs_open * 1e3);
+    printf("checked %d objects in %.3f ms, %d corrupt\n", b.count,
+	   secs_check * 1e3, b.bad);
+    if (b.bad > 0)
+	app_error("the heap lost data");
+    churn(&b);
+    check(&b);
+    if (b.bad > 0)
+	app_error("the heap lost data after churn");
+    printf("replaced a quarter of the objects, %d objects intact\n",
+	   b.count);
+    mem_deinit();
+    exit(0);
+}
@@ -0,0 +1,166 @@
+/*
+ * sizeclass.c - Size-class profiles and the mm.c headers built from them
+ *
+ * Shared by tracestat, which writes profiles and headers, and
+ * mkclasses, which builds headers from profiles.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sizeclass.h"
+
+#define MAXLINE 1024
+
+static void sc_error(const char *what, const char *path)
+{
+    fprintf(stderr, "sizeclass: %s %s\n", what, path);
+    exit(1);
+}
+
+/*
+ * sc_read_profile - parse the profile at path
+ */
+void sc_read_profile(const char *path, sc_profile_t *p)
+{
+    FILE *fp;
+    char line[MAXLINE], key[MAXLINE], *c;
+    unsigned long val;
+
+    memset(p, 0, sizeof(*p));
+    p->lut = SC_LUT;
+    if ((fp = fopen(path, "r")) == NULL)
+	sc_error("could not open", path);
+    while (fgets(line, MAXLINE, fp) != NULL) {
+	if ((c = strchr(line, '#')) != NULL)
+	    *c = '\0';
+	if (sscanf(line, "%s", key) != 1)
+	    continue;
+	if (sscanf(line, "%s %lu", key, &val) != 2)
+	    sc_error("missing value in", path);
+	if (!strcmp(key, "classes") && val >= 1 && val <= SC_MAX)
+	    p->classes = val;
+	else if (!strcmp(key, "hot") && p->nhot < SC_MAX)
+	    p->hot[p->nhot++] = val;
+	else if (!strcmp(key, "bound") && p->nbound < SC_MAX)
+	    p->bound[p->nbound++] = val;
+	else if (!strcmp(key, "lut"))
+	    p->lut = val;
+	else
+	    sc_error("bad directive in", path);
+    }
+    fclose(fp);
+}
+
+/*
+ * sc_write_profile - write p in the format sc_read_profile reads
+ */
+void sc_write_profile(FILE *fp, const sc_profile_t *p)
+{
+    int i;
+
+    if (p->classes)
+	fprintf(fp, "classes %d\n", p->classes);
+    for (i = 0; i < p->nhot; i++)
+	fprintf(fp, "hot %lu\n", (unsigned long)p->hot[i]);
+    for (i = 0; i < p->nbound; i++)
+	fprintf(fp, "bound %lu\n", (unsigned long)p->bound[i]);
+    fprintf(fp, "lut %lu\n", (unsigned long)p->lut);
+}
+
+static int by_value(const void *a, const void *b)
+{
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* sort limits and drop duplicates, returning how many are left */
+static int sort_unique(size_t *limits, int n)
+{
+    int i, m = 0;
+
+    qsort(limits, n, sizeof(size_t), by_value);
+    for (i = 0; i < n; i++)
+	if (m == 0 || limits[i] != limits[m - 1])
+	    limits[m++] = limits[i];
+    return m;
+}
+
+/* add a limit if there is room for it */
+#define ADD(x) do { if (n < 2 * SC_MAX) limits[n++] = (x); } while (0)
+
+/*
+ * sc_limits - the class limits for a profile: every hot size gets a
+ *     class of its own block size, bounds are taken as they are, and if
+ *     that leaves fewer than p->classes classes, powers of two fill the
+ *     gaps. limits must have room for 2 * SC_MAX entries. limits[i] is
+ *     the largest block size of class i and the last class is
+ *     unbounded. Returns the number of classes.
+ */
+int sc_limits(const sc_profile_t *p, size_t *limits)
+{
+    size_t a, pow;
+    int i, n = 0, max;
+
+    for (i = 0; i < p->nhot; i++) {
+	a = SC_ASIZE(p->hot[i]);
+	if (a - SC_DSIZE >= 2 * SC_DSIZE)
+	    ADD(a - SC_DSIZE);
+	ADD(a);
+    }
+    for (i = 0; i < p->nbound; i++) {
+	a = (p->bound[i] + SC_DSIZE - 1) / SC_DSIZE * SC_DSIZE;
+	ADD(a < 2 * SC_DSIZE ? 2 * SC_DSIZE : a);
+    }
+    n = sort_unique(limits, n);
+
+    max = (p->classes ? p->classes : SC_MAX) - 1;
+    for (pow = 2 * SC_DSIZE; p->classes && n < max && pow <= (1UL << 30);
+	 pow <<= 1) {
+	ADD(pow);
+	n = sort_unique(limits, n);
+    }
+    if (n > max)
+	n = max;
+    limits[n++] = (size_t)-1;
+    return n;
+}
+
+/* the class of block size asize, for the lookup table */
+static int class_of(const size_t *limits, int n, size_t asize)
+{
+    int i;
+
+    for (i = 0; i < n - 1 && limits[i] < asize; i++)
+	;
+    return i;
+}
+
+/*
+ * sc_write_header - write the classes as a header for mm.c, with a
+ *     table of the class of each block size up to lut
+ */
+void sc_write_header(FILE *fp, const size_t *limits, int n, size_t lut,
+		     const char *source)
+{
+    size_t i, entries = lut / SC_DSIZE + 1;
+
+    fprintf(fp, "/*\n * Size classes for mm.c generated from %s\n */\n",
+	    source);
+    fprintf(fp, "#define SEG_LIST_LEN %d\n", n);
+    fprintf(fp, "#define MM_CLASS_GRAIN %lu\n", (unsigned long)SC_DSIZE);
+    fprintf(fp, "#define MM_CLASS_LIMITS {");
+    for (i = 0; i < (size_t)n - 1; i++)
+	fprintf(fp, "%s%lu", i ? ", " : "", (unsigned long)limits[i]);
+    fprintf(fp, "%s(size_t)-1}\n", n > 1 ? ", " : "");
+
+    /* the class of block size i * MM_CLASS_GRAIN */
+    fprintf(fp, "#define MM_CLASS_LUT_MAX %lu\n",
+	    (unsigned long)((entries - 1) * SC_DSIZE));
+    fprintf(fp, "#define MM_CLASS_LUT {");
+    for (i = 0; i < entries; i++)
+	fprintf(fp, "%s%s%d", i ? "," : "", (i % 16) ? " " : " \\\n    ",
+		class_of(limits, n, i * SC_DSIZE));
+    fprintf(fp, "}\n");
+}
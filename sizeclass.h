@@ -0,0 +1,44 @@
+/*
+ * sizeclass.h - Size-class profiles and the mm.c headers built from them
+ *
+ * A profile is a text file of directives, one per line, with '#'
+ * starting a comment:
+ *
+ *   classes <n>     number of free-list classes, at most SC_MAX
+ *   hot <bytes>     a request size that gets an exact-fit class
+ *   bound <bytes>   the largest block size of some class
+ *   lut <bytes>     largest block size mapped by table lookup
+ *
+ * Profiles are written by hand or by tracestat -p. mkclasses turns one
+ * into a header that mm.c is built with (see PROFILE in the Makefile):
+ * the class limits, and a table from block size to class covering the
+ * sizes up to the lut bound so that the common case is a single load.
+ */
+#ifndef __SIZECLASS_H_
+#define __SIZECLASS_H_
+
+#include <stdio.h>
+
+#define SC_MAX  255                  /* classes fit in an unsigned char */
+#define SC_DSIZE (2 * sizeof(void *)) /* mm.c block alignment */
+#define SC_LUT  4096                 /* default lut bound */
+
+/* Block size that mm_malloc uses for a request, as in mm.c */
+#define SC_ASIZE(s) ((s) <= SC_DSIZE ? 2 * SC_DSIZE : \
+		     SC_DSIZE * (((s) + SC_DSIZE + SC_DSIZE - 1) / SC_DSIZE))
+
+typedef struct {
+    int classes;             /* 0 means just the hot and bound classes */
+    int nhot, nbound;
+    size_t hot[SC_MAX];      /* request sizes */
+    size_t bound[SC_MAX];    /* block sizes */
+    size_t lut;
+} sc_profile_t;
+
+void sc_read_profile(const char *path, sc_profile_t *p);
+void sc_write_profile(FILE *fp, const sc_profile_t *p);
+int sc_limits(const sc_profile_t *p, size_t *limits);
+void sc_write_header(FILE *fp, const size_t *limits, int n, size_t lut,
+		     const char *source);
+
+#endif /* __SIZECLASS_H_ */
@@ -0,0 +1,255 @@
+/*
+ * templatebench.c - Workers that start from a heap template against
+ *     workers that build their heap themselves
+ *
+ * usage: templatebench [-n <objects>] [-s <max size>] [-w <workers>]
+ *                      [-o <ops>]
+ *
+ * The parent builds a table of n objects filled with a checksummed
+ * pattern in a heap kept in a memory file (mem_init_memfd), and copies
+ * the heap into a template with mm_snapshot. It then forks w workers
+ * twice. The first time each worker builds the same objects in a heap
+ * of its own; the second time each worker maps the template
+ * copy-on-write and takes it up with mm_attach. Either way a worker then
+ * replaces o random objects, checking each one before freeing it. The
+ * report gives, per worker, how long it took until its objects were
+ * ready and the minor page faults it took until then and during the
+ * replacements.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+
+/* An object of the table */
+typedef struct {
+    int size;                /* bytes of data */
+    unsigned sum;            /* checksum of data */
+    unsigned char data[];
+} obj_t;
+
+/* Benchmark parameters */
+typedef struct {
+    int objects;             /* objects in the table */
+    int max_size;            /* data sizes are uniform in 1..max_size */
+    int workers;             /* processes forked per run */
+    int ops;                 /* objects each worker replaces */
+    int fd;                  /* the template */
+} bench_t;
+
+/* What a worker reports to the parent */
+typedef struct {
+    double secs_ready;       /* until its objects were ready */
+    long flt_ready;          /* minor faults until then */
+    long flt_ops;            /* minor faults during the replacements */
+    int bad;                 /* objects whose checksum failed */
+} result_t;
+
+int verbose = 0;             /* read by the timer routines */
+
+static void app_error(char *msg)
+{
+    fprintf(stderr, "templatebench: %s\n", msg);
+    exit(1);
+}
+
+static unsigned checksum(const unsigned char *p, int n)
+{
+    unsigned sum = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+	sum = sum * 31 + p[i];
+    return sum;
+}
+
+/* minflt - minor page faults taken by this process so far */
+static long minflt(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt;
+}
+
+/* new_obj - allocate an object with size bytes of pattern */
+static obj_t *new_obj(int size)
+{
+    obj_t *o;
+    int i;
+
+    if ((o = mm_malloc(sizeof(obj_t) + size)) == NULL)
+	app_error("the heap ran out of memory");
+    o->size = size;
+    for (i = 0; i < size; i++)
+	o->data[i] = (unsigned char)rand();
+    o->sum = checksum(o->data, size);
+    return o;
+}
+
+/* build - make the table in a new heap */
+static void build(void *argp)
+{
+    bench_t *b = (bench_t *)argp;
+    obj_t **tab;
+    int i;
+
+    mem_init_memfd();
+    if (mm_init() < 0)
+	app_error("mm_init failed");
+    srand(1);
+    if ((tab = mm_malloc(b->objects * sizeof(obj_t *))) == NULL)
+	app_error("the heap ran out of memory");
+    for (i = 0; i < b->objects; i++)
+	tab[i] = new_obj(1 + rand() % b->max_size);
+    mm_set_root(tab);
+}
+
+/* attach - take up the table in a copy-on-write mapping of the template */
+static void attach(void *argp)
+{
+    bench_t *b = (bench_t *)argp;
+
+    if (!mem_init_snapshot(b->fd) || mm_attach() < 0)
+	app_error("the template holds no heap");
+}
+
+/* replace - free ops random objects, checking each, and allocate new ones */
+static int replace(bench_t *b)
+{
+    obj_t **tab = mm_get_root();
+    int i, k, bad = 0;
+
+    for (k = 0; k < b->ops; k++) {
+	i = rand() % b->objects;
+	if (checksum(tab[i]->data, tab[i]->size) != tab[i]->sum)
+	    bad++;
+	mm_free(tab[i]);
+	tab[i] = new_obj(1 + rand() % b->max_size);
+    }
+    return bad;
+}
+
+/* worker - the body of a forked worker, which writes its result to fd */
+static void worker(bench_t *b, void (*ready)(void *), int fd)
+{
+    result_t r;
+    long flt = minflt();
+
+    r.secs_ready = ftimer_gettod(ready, b, 1);
+    r.flt_ready = minflt() - flt;
+    flt = minflt();
+    srand(getpid());
+    r.bad = replace(b);
+    r.flt_ops = minflt() - flt;
+    if (write(fd, &r, sizeof(r)) != sizeof(r))
+	app_error("could not report a result");
+    exit(0);
+}
+
+/* run - fork the workers and print the mean of their results */
+static void run(bench_t *b, void (*ready)(void *), char *name)
+{
+    result_t r, sum = {0, 0, 0, 0};
+    int pfd[2];
+    int i;
+
+    if (pipe(pfd) < 0)
+	app_error("could not create a pipe");
+    fflush(stdout);
+    for (i = 0; i < b->workers; i++) {
+	switch (fork()) {
+	case -1:
+	    app_error("could not fork a worker");
+	    break;
+	case 0:
+	    close(pfd[0]);
+	    worker(b, ready, pfd[1]);
+	}
+    }
+    close(pfd[1]);
+    for (i = 0; i < b->workers; i++) {
+	if (read(pfd[0], &r, sizeof(r)) != sizeof(r))
+	    app_error("a worker failed");
+	sum.secs_ready += r.secs_ready;
+	sum.flt_ready += r.flt_ready;
+	sum.flt_ops += r.flt_ops;
+	sum.bad += r.bad;
+    }
+    close(pfd[0]);
+    while (wait(NULL) > 0)
+	;
+    if (sum.bad > 0)
+	app_error("a worker found a corrupt object");
+    printf("%-10s%11.3f%12.0f%12.0f\n", name,
+	   sum.secs_ready * 1e3 / b->workers,
+	   (double)sum.flt_ready / b->workers,
+	   (double)sum.flt_ops / b->workers);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: templatebench [-n <objects>] [-s <max size>] "
+	    "[-w <workers>] [-o <ops>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-n <n>     Objects in the table (50000).\n");
+    fprintf(stderr, "\t-s <n>     Data sizes are uniform in 1..n (200).\n");
+    fprintf(stderr, "\t-w <n>     Workers forked per run (8).\n");
+    fprintf(stderr, "\t-o <n>     Objects each worker replaces (1000).\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
+
+int main(int argc, char **argv)
+{
+    bench_t b = {50000, 200, 8, 1000, -1};
+    double secs_build;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:w:o:h")) != EOF) {
+	switch (c) {
+	case 'n':
+	    b.objects = atoi(optarg);
+	    break;
+	case 's':
+	    b.max_size = atoi(optarg);
+	    break;
+	case 'w':
+	    b.workers = atoi(optarg);
+	    break;
+	case 'o':
+	    b.ops = atoi(optarg);
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (b.objects < 1 || b.max_size < 1 || b.workers < 1 || b.ops < 0)
+	app_error("objects, sizes and workers must be positive");
+
+    init_fsecs();
+    secs_build = ftimer_gettod(build, &b, 1);
+    if ((b.fd = mm_snapshot()) < 0)
+	app_error("mm_snapshot failed");
+    printf("built %d objects (%.0f KB heap) in %.3f ms\n", b.objects,
+	   mem_heapsize() / 1024.0, secs_build * 1e3);
+    mem_deinit();
+
+    printf("per worker, %d workers replacing %d objects each\n", b.workers,
+	   b.ops);
+    printf("%-10s%11s%12s%12s\n", "", "ready ms", "faults", "op faults");
+    run(&b, build, "build");
+    run(&b, attach, "template");
+    close(b.fd);
+    exit(0);
+}
@@ -0,0 +1,295 @@
+/*
+ * trace.c - Reading and writing allocator trace files
+ *
+ * Shared by mdriver and the trace tools. Errors are reported on stderr
+ * and are fatal, as in memlib.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "trace.h"
+
+#define TRACE_BUFRECS 65536 /* binary records per read or write */
+#define TRACE_TYPE(w)  ((w) >> 30)
+#define TRACE_HINT(w)  (((w) >> 28) & (TRACE_HINTS - 1))
+#define TRACE_INDEX(w) ((w) & (TRACE_MAX_IDS - 1))
+
+/* report a fatal error about the trace at path */
+static void trace_error(const char *what, const char *path)
+{
+    fprintf(stderr, "trace: %s %s\n", what, path);
+    exit(1);
+}
+
+/* allocate the arrays of a trace whose header has been read */
+static void trace_alloc(trace_t *trace, const char *path)
+{
+    if (trace->num_ops < 0 || trace->num_ids < 0)
+	trace_error("bad header in", path);
+
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops =
+	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	trace_error("no memory for the ops of", path);
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks =
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	trace_error("no memory for the blocks of", path);
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes =
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	trace_error("no memory for the block sizes of", path);
+}
+
+/* read the ops of a text trace */
+static void read_text(FILE *tracefile, trace_t *trace, const char *path)
+{
+    char type[64];
+    unsigned index, size, hint;
+    int max_index = 0;
+    int op_index;
+
+    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
+    fscanf(tracefile, "%d", &(trace->num_ids));
+    fscanf(tracefile, "%d", &(trace->num_ops));
+    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
+    trace_alloc(trace, path);
+
+    /* read every request line in the trace file */
+    index = 0;
+    op_index = 0;
+    while (fscanf(tracefile, "%63s", type) != EOF) {
+	if (op_index >= trace->num_ops)
+	    trace_error("more ops than its header says in", path);
+	trace->ops[op_index].hint = 0;
+	switch(type[0]) {
+	case 'a':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    /* an optional hint on the same line */
+	    if (fscanf(tracefile, "%*[ \t]%u", &hint) == 1) {
+		if (hint >= TRACE_HINTS)
+		    trace_error("bad hint in", path);
+		trace->ops[op_index].hint = hint;
+	    }
+	    trace->ops[op_index].type = ALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = ((int)index > max_index) ? (int)index : max_index;
+	    break;
+	case 'r':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = REALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = ((int)index > max_index) ? (int)index : max_index;
+	    break;
+	case 'f':
+	    fscanf(tracefile, "%ud", &index);
+	    trace->ops[op_index].type = FREE;
+	    trace->ops[op_index].index = index;
+	    break;
+	default:
+	    fprintf(stderr, "Bogus type character (%c) in tracefile %s\n",
+		    type[0], path);
+	    exit(1);
+	}
+	op_index++;
+    }
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+}
+
+/* read the header and ops of a binary trace, after its magic */
+static void read_binary(FILE *tracefile, trace_t *trace, const char *path)
+{
+    int32_t hdr[4];
+    trace_rec_t *buf;
+    traceop_t *op;
+    int i, n, done;
+
+    if (fread(hdr, sizeof(hdr), 1, tracefile) != 1)
+	trace_error("truncated header in", path);
+    trace->sugg_heapsize = hdr[0];
+    trace->num_ids = hdr[1];
+    trace->num_ops = hdr[2];
+    trace->weight = hdr[3];
+    trace_alloc(trace, path);
+
+    if ((buf = malloc(TRACE_BUFRECS * sizeof(trace_rec_t))) == NULL)
+	trace_error("no memory to read", path);
+    for (done = 0; done < trace->num_ops; done += n) {
+	n = trace->num_ops - done;
+	if (n > TRACE_BUFRECS)
+	    n = TRACE_BUFRECS;
+	if (fread(buf, sizeof(trace_rec_t), n, tracefile) != (size_t)n)
+	    trace_error("truncated ops in", path);
+	for (i = 0; i < n; i++) {
+	    op = &trace->ops[done + i];
+	    op->type = TRACE_TYPE(buf[i].type_index);
+	    op->index = TRACE_INDEX(buf[i].type_index);
+	    op->hint = TRACE_HINT(buf[i].type_index);
+	    op->size = buf[i].size;
+	    if (op->index >= trace->num_ids || op->type > REALLOC)
+		trace_error("bad op in", path);
+	}
+    }
+    free(buf);
+}
+
+/*
+ * trace_read - read a trace file in either encoding and store it in
+ *     memory
+ */
+trace_t *trace_read(const char *path)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    char magic[TRACE_MAGIC_LEN];
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	trace_error("no memory to read", path);
+
+    if ((tracefile = fopen(path, "rb")) == NULL)
+	trace_error("could not open", path);
+    if (fread(magic, TRACE_MAGIC_LEN, 1, tracefile) != 1)
+	memset(magic, 0, TRACE_MAGIC_LEN);
+    if (memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0) {
+	read_binary(tracefile, trace, path);
+    }
+    else {
+	rewind(tracefile);
+	read_text(tracefile, trace, path);
+    }
+    fclose(tracefile);
+    return trace;
+}
+
+/*
+ * trace_free - Free the trace record and the three arrays it points
+ *     to, all of which were allocated in trace_read().
+ */
+void trace_free(trace_t *trace)
+{
+    free(trace->ops);         /* free the three arrays... */
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
+
+/* write the header; it is rewritten in place once the counts are known */
+static void write_header(tracewriter_t *w)
+{
+    int32_t hdr[4];
+    double heap = w->heap_bytes + 100;
+
+    hdr[0] = heap > 0x7fffffff ? 0x7fffffff : (int32_t)heap;
+    hdr[1] = w->num_ids;
+    hdr[2] = w->num_ops;
+    hdr[3] = 1;
+    if (w->binary) {
+	fwrite(TRACE_MAGIC, TRACE_MAGIC_LEN, 1, w->fp);
+	fwrite(hdr, sizeof(hdr), 1, w->fp);
+    }
+    else {
+	/* fixed width, so that the rewrite does not clobber the ops */
+	fprintf(w->fp, "%10d\n%10d\n%10d\n%10d\n",
+		hdr[0], hdr[1], hdr[2], hdr[3]);
+    }
+}
+
+/* write out the pending binary records */
+static void flush_recs(tracewriter_t *w)
+{
+    if (w->nbuf > 0 &&
+	fwrite(w->buf, sizeof(trace_rec_t), w->nbuf, w->fp) != (size_t)w->nbuf)
+	trace_error("write error on", "trace");
+    w->nbuf = 0;
+}
+
+/*
+ * trace_writer_open - start writing a trace to path, as text or binary.
+ *     The file must be seekable, since the header is filled in by
+ *     trace_writer_close().
+ */
+tracewriter_t *trace_writer_open(const char *path, int binary)
+{
+    tracewriter_t *w;
+
+    if ((w = calloc(1, sizeof(*w))) == NULL)
+	trace_error("no memory to write", path);
+    if ((w->fp = fopen(path, binary ? "wb" : "w")) == NULL)
+	trace_error("could not create", path);
+    w->binary = binary;
+    if (binary &&
+	(w->buf = malloc(TRACE_BUFRECS * sizeof(trace_rec_t))) == NULL)
+	trace_error("no memory to write", path);
+    write_header(w);
+    return w;
+}
+
+/*
+ * trace_write_op - append one op. size is ignored for FREE, and hint
+ *     for everything but ALLOC.
+ */
+void trace_write_op(tracewriter_t *w, int type, int index, int size,
+		    int hint)
+{
+    if (index < 0 || index >= TRACE_MAX_IDS)
+	trace_error("block id out of range for", "trace");
+    if (hint < 0 || hint >= TRACE_HINTS)
+	trace_error("hint out of range for", "trace");
+    if (type != ALLOC)
+	hint = 0;
+    if (w->num_ops == INT_MAX)
+	trace_error("too many ops for", "trace");
+    if (index >= w->num_ids)
+	w->num_ids = index + 1;
+    if (type != FREE)
+	w->heap_bytes += size;
+    w->num_ops++;
+
+    if (w->binary) {
+	w->buf[w->nbuf].type_index =
+	    ((uint32_t)type << 30) | ((uint32_t)hint << 28) | index;
+	w->buf[w->nbuf].size = (type == FREE) ? 0 : size;
+	if (++w->nbuf == TRACE_BUFRECS)
+	    flush_recs(w);
+	return;
+    }
+    switch (type) {
+    case ALLOC:
+	if (hint)
+	    fprintf(w->fp, "a %d %d %d\n", index, size, hint);
+	else
+	    fprintf(w->fp, "a %d %d\n", index, size);
+	break;
+    case REALLOC:
+	fprintf(w->fp, "r %d %d\n", index, size);
+	break;
+    default:
+	fprintf(w->fp, "f %d\n", index);
+	break;
+    }
+}
+
+/*
+ * trace_writer_close - fill in the header and close the trace
+ */
+void trace_writer_close(tracewriter_t *w)
+{
+    if (w->binary)
+	flush_recs(w);
+    if (fseek(w->fp, 0, SEEK_SET) != 0)
+	trace_error("cannot seek to rewrite the header of", "trace");
+    write_header(w);
+    if (fclose(w->fp) != 0)
+	trace_error("write error on", "trace");
+    free(w->buf);
+    free(w);
+}
@@ -0,0 +1,76 @@
+/*
+ * trace.h - Reading and writing allocator trace files
+ *
+ * A trace is a header (suggested heap size, number of block ids,
+ * number of ops, weight) followed by one request per op. Traces come
+ * in two encodings with the same content:
+ *
+ *   text    the original .rep format, one "a id size", "r id size" or
+ *           "f id" line per op. An "a" line may end in a lifetime
+ *           hint (see mm_malloc_hint in mm.h), "a id size hint".
+ *   binary  the magic TRACE_MAGIC, the four header fields as 32-bit
+ *           ints, and one 8-byte record per op (see trace_rec_t).
+ *           Used for traces too large to parse as text in reasonable
+ *           time.
+ *
+ * trace_read() accepts either encoding.
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define TRACE_MAGIC     "MMTRACE1"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_MAX_IDS   (1 << 28) /* ids share a word with type and hint */
+#define TRACE_HINTS     4         /* hints are 0 (none) to 3 */
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+    int hint;                         /* lifetime hint of an alloc, or 0 */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+} trace_t;
+
+/*
+ * One op of a binary trace: the type in the top 2 bits, the hint in the
+ * next 2, then the id
+ */
+typedef struct {
+    uint32_t type_index;
+    uint32_t size;
+} trace_rec_t;
+
+/* Writes a trace one op at a time, without holding it in memory */
+typedef struct {
+    FILE *fp;
+    int binary;          /* encoding being written */
+    int num_ids;         /* 1 + largest id written so far */
+    int num_ops;         /* ops written so far */
+    double heap_bytes;   /* sum of the alloc and realloc sizes */
+    trace_rec_t *buf;    /* pending binary records */
+    int nbuf;
+} tracewriter_t;
+
+trace_t *trace_read(const char *path);
+void trace_free(trace_t *trace);
+
+tracewriter_t *trace_writer_open(const char *path, int binary);
+void trace_write_op(tracewriter_t *w, int type, int index, int size,
+		    int hint);
+void trace_writer_close(tracewriter_t *w);
+
+#endif /* __TRACE_H_ */
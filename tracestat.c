@@ -0,0 +1,406 @@
+/*
+ * tracestat.c - Size-class and lifetime profile of allocator traces
+ *
+ * Reads one or more traces (.rep or binary) and reports the request
+ * size histogram, the most common exact sizes, the lifetime of blocks
+ * in each size class, the live set over time and the growth ratios of
+ * reallocs. From the combined size distribution it suggests a table of
+ * free-list size classes, which it can write as a profile (see
+ * sizeclass.h) or directly as a header that mm.c is built with (see
+ * PROFILE and MM_CLASSES in the Makefile).
+ *
+ * usage: tracestat [-k <classes>] [-n <top>] [-p <profile>] [-c <header>]
+ *                  trace...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "trace.h"
+#include "lathist.h"
+#include "sizeclass.h"
+
+#define NTOP        10   /* default number of exact sizes to list */
+#define NCLASSES    20   /* default number of size classes, as in mm.c */
+#define HOT_SHARE   0.02 /* share of requests that makes a size hot */
+#define LIVE_POINTS 10   /* samples of the live set per trace */
+
+/* Realloc growth ratio buckets, by upper bound */
+static const double growth_bound[] = {0.5, 1.0, 1.0001, 1.25, 1.5, 2.0, 4.0};
+static const char *growth_name[] =
+    {"< 0.5", "< 1", "= 1", "< 1.25", "< 1.5", "< 2", "< 4", ">= 4"};
+#define NGROWTH 8
+
+/* Counts per distinct size, in an open-addressing hash table */
+typedef struct {
+    size_t key;                 /* size + 1, so that 0 marks a free slot */
+    unsigned long long count;
+} sizecount_t;
+
+typedef struct {
+    sizecount_t *slot;
+    size_t cap, n;
+} sizetab_t;
+
+/* Everything accumulated over all traces */
+static sizetab_t req_sizes;           /* exact request sizes */
+static sizetab_t blk_sizes;           /* the same, rounded to block sizes */
+static unsigned long long size_hist[LAT_NSIZES];
+static unsigned long long num_requests;
+static lathist_t lifetime[LAT_NSIZES];
+static unsigned long long growth[NGROWTH];
+static unsigned long long num_reallocs;
+
+static void app_error(char *msg)
+{
+    fprintf(stderr, "tracestat: %s\n", msg);
+    exit(1);
+}
+
+/* find the slot for size, claiming a free one if it is new */
+static sizecount_t *tab_slot(sizetab_t *t, size_t size)
+{
+    size_t i;
+
+    for (i = (size * 0x9E3779B97F4A7C15ULL) & (t->cap - 1);
+	 t->slot[i].key && t->slot[i].key != size + 1;
+	 i = (i + 1) & (t->cap - 1))
+	;
+    if (!t->slot[i].key) {
+	t->slot[i].key = size + 1;
+	t->n++;
+    }
+    return &t->slot[i];
+}
+
+/*
+ * tab_add - count one more occurrence of size, doubling the table
+ *     when it is half full
+ */
+static void tab_add(sizetab_t *t, size_t size)
+{
+    sizecount_t *old = t->slot;
+    size_t i, oldcap = t->cap;
+
+    if (2 * (t->n + 1) > t->cap) {
+	t->cap = oldcap ? 2 * oldcap : 1024;
+	if ((t->slot = calloc(t->cap, sizeof(sizecount_t))) == NULL)
+	    app_error("no memory for the size table");
+	t->n = 0;
+	for (i = 0; i < oldcap; i++)
+	    if (old[i].key)
+		tab_slot(t, old[i].key - 1)->count = old[i].count;
+	free(old);
+    }
+    tab_slot(t, size)->count++;
+}
+
+/* sort sizecounts by decreasing count */
+static int by_count(const void *a, const void *b)
+{
+    const sizecount_t *x = a, *y = b;
+
+    if (x->count != y->count)
+	return (x->count < y->count) ? 1 : -1;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+/* sort sizecounts by increasing size */
+static int by_size(const void *a, const void *b)
+{
+    const sizecount_t *x = a, *y = b;
+
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+/*
+ * tab_sorted - the occupied slots of t, sorted with cmp
+ */
+static sizecount_t *tab_sorted(sizetab_t *t, int (*cmp)(const void *,
+							 const void *))
+{
+    sizecount_t *v;
+    size_t i, n = 0;
+
+    if ((v = malloc((t->n + 1) * sizeof(sizecount_t))) == NULL)
+	app_error("no memory to sort the size table");
+    for (i = 0; i < t->cap; i++)
+	if (t->slot[i].key)
+	    v[n++] = t->slot[i];
+    qsort(v, n, sizeof(sizecount_t), cmp);
+    return v;
+}
+
+/* count one alloc or realloc request of size */
+static void add_request(int size)
+{
+    tab_add(&req_sizes, size);
+    tab_add(&blk_sizes, SC_ASIZE((size_t)size));
+    size_hist[lathist_size_class(size)]++;
+    num_requests++;
+}
+
+/*
+ * scan_trace - accumulate the statistics of one trace and print its
+ *     live set over time
+ */
+static void scan_trace(char *path)
+{
+    trace_t *trace;
+    traceop_t *op;
+    int *born, *size;
+    long long live = 0, peak = 0, peak_blocks = 0, blocks = 0;
+    double ratio;
+    int i, g, next_point = 1;
+
+    trace = trace_read(path);
+    born = malloc(trace->num_ids * sizeof(int));
+    size = malloc(trace->num_ids * sizeof(int));
+    if (born == NULL || size == NULL)
+	app_error("no memory for the block table");
+
+    printf("%s: %d ops, %d blocks\n  live bytes:", path, trace->num_ops,
+	   trace->num_ids);
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	switch (op->type) {
+	case ALLOC:
+	    add_request(op->size);
+	    born[op->index] = i;
+	    size[op->index] = op->size;
+	    live += op->size;
+	    blocks++;
+	    break;
+	case REALLOC:
+	    add_request(op->size);
+	    ratio = size[op->index] ? (double)op->size / size[op->index] : 1;
+	    for (g = 0; g < NGROWTH - 1 && ratio >= growth_bound[g]; g++)
+		;
+	    growth[g]++;
+	    num_reallocs++;
+	    live += op->size - size[op->index];
+	    size[op->index] = op->size;
+	    break;
+	case FREE:
+	    lathist_add(&lifetime[lathist_size_class(size[op->index])],
+			i - born[op->index]);
+	    live -= size[op->index];
+	    blocks--;
+	    break;
+	}
+	if (live > peak)
+	    peak = live;
+	if (blocks > peak_blocks)
+	    peak_blocks = blocks;
+	if ((long long)(i + 1) * LIVE_POINTS >=
+	    (long long)next_point * trace->num_ops) {
+	    printf(" %lld", live);
+	    next_point++;
+	}
+    }
+    printf("\n  peak %lld bytes in %lld blocks\n", peak, peak_blocks);
+
+    free(born);
+    free(size);
+    trace_free(trace);
+}
+
+/*
+ * suggest_classes - profile up to k free-list size classes for the
+ *     block sizes seen: an exact class for every hot size, with at most
+ *     half of the classes, and bounds at equal-mass quantiles of the
+ *     remaining sizes
+ */
+static void suggest_classes(int k, sc_profile_t *p)
+{
+    sizecount_t *v = tab_sorted(&blk_sizes, by_count);
+    sizecount_t *req = tab_sorted(&req_sizes, by_count);
+    size_t i, j, n = blk_sizes.n;
+    unsigned long long rest = 0, seen = 0;
+    int nl = 0, q, nq;
+
+    memset(p, 0, sizeof(*p));
+    p->classes = k;
+    p->lut = SC_LUT;
+
+    /*
+     * Each hot block size takes the class below it as well. It is
+     * profiled as its most common request size.
+     */
+    for (i = 0; i < n && nl + 2 < k && p->nhot < k / 2; i++) {
+	if (v[i].count < HOT_SHARE * num_requests)
+	    break;
+	for (j = 0; SC_ASIZE(req[j].key - 1) != v[i].key - 1; j++)
+	    ;
+	p->hot[p->nhot++] = req[j].key - 1;
+	nl += 2;
+	v[i].count = 0;
+    }
+
+    qsort(v, n, sizeof(sizecount_t), by_size);
+    for (i = 0; i < n; i++)
+	rest += v[i].count;
+    nq = k - 1 - nl;
+    for (i = 0, q = 1; i < n && q <= nq && rest > 0; i++) {
+	seen += v[i].count;
+	if (seen * (nq + 1) >= (unsigned long long)q * rest) {
+	    p->bound[p->nbound++] = v[i].key - 1;
+	    while (q <= nq && seen * (nq + 1) >= (unsigned long long)q * rest)
+		q++;
+	}
+    }
+    free(req);
+    free(v);
+}
+
+/*
+ * write_file - write the profile or the header for the suggested
+ *     classes to path
+ */
+static void write_file(char *path, sc_profile_t *p, int header,
+		       int argc, char **argv)
+{
+    FILE *fp;
+    char source[1024];
+    size_t limits[2 * SC_MAX];
+    int i, n;
+
+    if ((fp = fopen(path, "w")) == NULL)
+	app_error("could not create the output file");
+    strcpy(source, "tracestat");
+    for (i = 0; i < argc && strlen(source) + strlen(argv[i]) + 2 <
+	     sizeof(source); i++) {
+	strcat(source, " ");
+	strcat(source, argv[i]);
+    }
+    if (header) {
+	n = sc_limits(p, limits);
+	sc_write_header(fp, limits, n, p->lut, source);
+    }
+    else {
+	fprintf(fp, "# Size-class profile from %s\n", source);
+	sc_write_profile(fp, p);
+    }
+    fclose(fp);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracestat [-k <classes>] [-n <top>] "
+	    "[-p <profile>] [-c <header>]\n"
+	    "                 trace...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-k <n>     Suggest at most n size classes (%d).\n",
+	    NCLASSES);
+    fprintf(stderr, "\t-n <n>     List the n most common sizes (%d).\n",
+	    NTOP);
+    fprintf(stderr, "\t-p <file>  Write the size classes as a profile.\n");
+    fprintf(stderr, "\t-c <file>  Write the size classes as a header "
+	    "for mm.c.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, k = NCLASSES, ntop = NTOP, nclasses;
+    char *header = NULL, *profile = NULL;
+    sizecount_t *top;
+    size_t limits[2 * SC_MAX];
+    sc_profile_t prof;
+    unsigned long long cum = 0;
+    lathist_t *h;
+
+    while ((c = getopt(argc, argv, "k:n:p:c:h")) != EOF) {
+	switch (c) {
+	case 'k':
+	    k = atoi(optarg);
+	    break;
+	case 'n':
+	    ntop = atoi(optarg);
+	    break;
+	case 'p':
+	    profile = optarg;
+	    break;
+	case 'c':
+	    header = optarg;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (optind == argc || k < 2 || k > SC_MAX) {
+	usage();
+	exit(1);
+    }
+
+    for (i = 0; i < LAT_NSIZES; i++)
+	lathist_reset(&lifetime[i]);
+    for (i = optind; i < argc; i++)
+	scan_trace(argv[i]);
+    if (num_requests == 0)
+	app_error("no alloc or realloc requests in the traces");
+
+    printf("\nRequest sizes (%llu requests):\n", num_requests);
+    printf("%12s%12s%8s%8s\n", "size <=", "count", "%", "cum %");
+    for (i = 0; i < LAT_NSIZES; i++) {
+	if (size_hist[i] == 0)
+	    continue;
+	cum += size_hist[i];
+	if (i == LAT_NSIZES - 1)
+	    printf("%12s", "max");
+	else
+	    printf("%12d", lathist_size_class_max(i));
+	printf("%12llu%7.1f%%%7.1f%%\n", size_hist[i],
+	       100.0 * size_hist[i] / num_requests, 100.0 * cum / num_requests);
+    }
+
+    printf("\nMost common sizes:\n%12s%12s%8s\n", "size", "count", "%");
+    top = tab_sorted(&req_sizes, by_count);
+    for (i = 0; i < ntop && i < (int)req_sizes.n; i++)
+	printf("%12lu%12llu%7.1f%%\n", (unsigned long)(top[i].key - 1),
+	       top[i].count, 100.0 * top[i].count / num_requests);
+    free(top);
+
+    printf("\nLifetimes in ops:\n%12s%12s%10s%10s%10s%12s\n",
+	   "size <=", "frees", "p50", "p90", "p99", "max");
+    for (i = 0; i < LAT_NSIZES; i++) {
+	h = &lifetime[i];
+	if (h->count == 0)
+	    continue;
+	if (i == LAT_NSIZES - 1)
+	    printf("%12s", "max");
+	else
+	    printf("%12d", lathist_size_class_max(i));
+	printf("%12llu%10llu%10llu%10llu%12llu\n", h->count,
+	       (unsigned long long)lathist_quantile(h, 0.5),
+	       (unsigned long long)lathist_quantile(h, 0.9),
+	       (unsigned long long)lathist_quantile(h, 0.99),
+	       (unsigned long long)h->max);
+    }
+
+    if (num_reallocs > 0) {
+	printf("\nRealloc growth (new / old size, %llu reallocs):\n",
+	       num_reallocs);
+	for (i = 0; i < NGROWTH; i++)
+	    printf("%12s%12llu%7.1f%%\n", growth_name[i], growth[i],
+		   100.0 * growth[i] / num_reallocs);
+    }
+
+    suggest_classes(k, &prof);
+    nclasses = sc_limits(&prof, limits);
+    printf("\nSuggested size classes (block sizes, %d classes):\n ",
+	   nclasses);
+    for (i = 0; i < nclasses - 1; i++)
+	printf(" %lu", (unsigned long)limits[i]);
+    printf(" max\n");
+    if (profile)
+	write_file(profile, &prof, 0, argc - optind, argv + optind);
+    if (header)
+	write_file(header, &prof, 1, argc - optind, argv + optind);
+    exit(0);
+}